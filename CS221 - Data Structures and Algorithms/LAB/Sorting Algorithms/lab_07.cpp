@@ -1,4 +1,24 @@
 #include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <cstdint>
+#include <type_traits>
+#include <limits>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SIMD_SORT_AVAILABLE 1
+#else
+#define SIMD_SORT_AVAILABLE 0
+#endif
 using namespace std;
 
 // The return type of all of the sorting functions must be set to void, as they are to return nothing.
@@ -9,7 +29,54 @@ void DisplayArr(int arr[], int size) {
     }
 }
 
+// Tracing policies.
+// Every sorting function takes one as a template parameter and calls its hooks at the points
+// where it used to print. ConsoleTrace prints the steps (the default, so the menu still explains
+// every sort); NoTrace has empty hooks, which the compiler removes, so the same sort runs at full
+// speed on big arrays.
+struct ConsoleTrace {
+    static void afterPass(int arr[], int size, int pass) {
+        cout << "After pass " << pass << ": ";
+        DisplayArr(arr, size);
+        cout << endl;
+    }
+    static void afterInsertion(int arr[], int size, int position) {
+        cout << "After inserting element at position " << position << ": ";
+        DisplayArr(arr, size);
+        cout << endl;
+    }
+    static void afterSelection(int arr[], int size, int selection, int min) {
+        cout << "After selection " << selection << " (min = " << min << "): ";
+        DisplayArr(arr, size);
+        cout << endl;
+    }
+    static void afterMerge(int arr[], int l, int m, int r) {
+        cout << "After merging [" << l << "-" << m << "] and [" << m+1 << "-" << r << "]: ";
+        DisplayArr(arr + l, r - l + 1);
+        cout << endl;
+    }
+    static void afterPartition(int arr[], int low, int high, int pivot, int position) {
+        cout << "After partition (pivot " << pivot << " at position " << position << "): ";
+        DisplayArr(arr, high - low + 1);
+        cout << endl;
+    }
+    static void processingSubarray(int arr[], int low, int high) {
+        cout << "Processing subarray: ";
+        DisplayArr(arr + low, high - low + 1);
+        cout << endl;
+    }
+};
+
+struct NoTrace {
+    static void afterPass(int[], int, int) {}
+    static void afterInsertion(int[], int, int) {}
+    static void afterSelection(int[], int, int, int) {}
+    static void afterMerge(int[], int, int, int) {}
+    static void afterPartition(int[], int, int, int, int) {}
+    static void processingSubarray(int[], int, int) {}
+};
 
+template <typename Trace = ConsoleTrace>
 void BubbleSort(int arr[], int size) {
     int temp;
     for (int i = 0; i < size; i++) {
@@ -22,12 +89,11 @@ void BubbleSort(int arr[], int size) {
         
         } // corresponds to the inner for loop
         // Display after each pass
-        cout << "After pass " << i + 1 << ": ";
-        DisplayArr(arr, size);
-        cout << endl;
+        Trace::afterPass(arr, size, i + 1);
     } // corresponds to the outer for loop
 }
 
+template <typename Trace = ConsoleTrace>
 void InsertionSort(int arr[], int size) {
     for (int i = 1; i < size; i++) {
         int key = arr[i];
@@ -40,12 +106,11 @@ void InsertionSort(int arr[], int size) {
         
         arr[j+1] = key;
         // Display after each insertion
-        cout << "After inserting element at position " << i << ": ";
-        DisplayArr(arr, size);
-        cout << endl;
+        Trace::afterInsertion(arr, size, i);
     }
 }
 
+template <typename Trace = ConsoleTrace>
 void SelectionSort(int arr[], int size) {
     for (int i = 0; i < size - 1; i++) {
         // int first = arr[i];
@@ -60,18 +125,217 @@ void SelectionSort(int arr[], int size) {
         arr[i] = arr[minIndex];
         arr[minIndex] = temp; 
         // Display after each selection
-        cout << "After selection " << i + 1 << " (min = " << arr[i] << "): ";
-        DisplayArr(arr, size);
-        cout << endl;
+        Trace::afterSelection(arr, size, i + 1, arr[i]);
+    }
+}
+
+// Same as InsertionSort, for any key type
+template <typename Key>
+void InsertionSortKeys(Key arr[], long long size) {
+    for (long long i = 1; i < size; i++) {
+        Key key = arr[i];
+        long long j = i - 1;
+        while (j >= 0 && arr[j] > key) {
+            arr[j + 1] = arr[j];
+            j--;
+        }
+        arr[j + 1] = key;
+    }
+}
+
+// Sorting networks for small blocks (the base case of the divide-and-conquer sorts below).
+// A bitonic sorting network does the same fixed sequence of compare-exchanges whatever the
+// data is, so it has no unpredictable branches and a vector register can do 8 (AVX2, int32)
+// or 4 (SSE4) of them at once. SmallSort copies up to SIMD_SORT_MAX keys into a block padded
+// with the biggest key to a power of two, runs the network on it and copies the keys back.
+// Stage (k, j) compares element i with element i ^ j; the pair is put in ascending order when
+// bit k of i is 0 and in descending order otherwise. If j is at least the vector width, whole
+// vectors are compared with each other; otherwise the vector is compared with a copy of itself
+// whose lanes were swapped pairwise (Exchange) and Blend picks min or max per lane.
+// The kernel is chosen once, from what the CPU supports (SetSmallSortLevel can lower it):
+// AVX2, else SSE4.2, else InsertionSort. Not stable, which makes no difference for plain keys.
+const int SIMD_SORT_MAX = 64;
+
+enum SimdLevel { SIMD_NONE, SIMD_SSE4, SIMD_AVX2 };
+const char* simdLevelNames[3] = {"scalar", "SSE4.2", "AVX2"};
+
+#if SIMD_SORT_AVAILABLE
+// The vector types only ever live inside the kernels below, which all have the same target
+// as the traits they use, so GCC's warning about vector arguments changing the ABI is noise.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// Vector traits, one per instruction set and key type.
+// Mask(lanes) has all bits set in the lanes whose bit is set in `lanes`.
+struct Avx2Int32 {
+    typedef int32_t Key;
+    typedef __m256i Vec;
+    static const int LANES = 8;
+    __attribute__((target("avx2"))) static inline Vec Load(const Key* p) { return _mm256_load_si256((const Vec*)p); }
+    __attribute__((target("avx2"))) static inline void Store(Key* p, Vec v) { _mm256_store_si256((Vec*)p, v); }
+    __attribute__((target("avx2"))) static inline Vec Min(Vec a, Vec b) { return _mm256_min_epi32(a, b); }
+    __attribute__((target("avx2"))) static inline Vec Max(Vec a, Vec b) { return _mm256_max_epi32(a, b); }
+    __attribute__((target("avx2"))) static inline Vec Blend(Vec a, Vec b, Vec mask) { return _mm256_blendv_epi8(a, b, mask); }
+    __attribute__((target("avx2"))) static inline Vec Exchange(Vec v, int j) {
+        Vec lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        return _mm256_permutevar8x32_epi32(v, _mm256_xor_si256(lanes, _mm256_set1_epi32(j)));
+    }
+    __attribute__((target("avx2"))) static inline Vec Mask(int lanes) {
+        Vec bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+        return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(lanes), bits), bits);
+    }
+};
+
+struct Avx2Int64 {
+    typedef int64_t Key;
+    typedef __m256i Vec;
+    static const int LANES = 4;
+    __attribute__((target("avx2"))) static inline Vec Load(const Key* p) { return _mm256_load_si256((const Vec*)p); }
+    __attribute__((target("avx2"))) static inline void Store(Key* p, Vec v) { _mm256_store_si256((Vec*)p, v); }
+    __attribute__((target("avx2"))) static inline Vec Min(Vec a, Vec b) { return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b)); }
+    __attribute__((target("avx2"))) static inline Vec Max(Vec a, Vec b) { return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b)); }
+    __attribute__((target("avx2"))) static inline Vec Blend(Vec a, Vec b, Vec mask) { return _mm256_blendv_epi8(a, b, mask); }
+    __attribute__((target("avx2"))) static inline Vec Exchange(Vec v, int j) {
+        return j == 1 ? _mm256_permute4x64_epi64(v, 0xB1) : _mm256_permute4x64_epi64(v, 0x4E);
+    }
+    __attribute__((target("avx2"))) static inline Vec Mask(int lanes) {
+        Vec bits = _mm256_setr_epi64x(1, 2, 4, 8);
+        return _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(lanes), bits), bits);
+    }
+};
+
+struct Sse4Int32 {
+    typedef int32_t Key;
+    typedef __m128i Vec;
+    static const int LANES = 4;
+    __attribute__((target("sse4.2"))) static inline Vec Load(const Key* p) { return _mm_load_si128((const Vec*)p); }
+    __attribute__((target("sse4.2"))) static inline void Store(Key* p, Vec v) { _mm_store_si128((Vec*)p, v); }
+    __attribute__((target("sse4.2"))) static inline Vec Min(Vec a, Vec b) { return _mm_min_epi32(a, b); }
+    __attribute__((target("sse4.2"))) static inline Vec Max(Vec a, Vec b) { return _mm_max_epi32(a, b); }
+    __attribute__((target("sse4.2"))) static inline Vec Blend(Vec a, Vec b, Vec mask) { return _mm_blendv_epi8(a, b, mask); }
+    __attribute__((target("sse4.2"))) static inline Vec Exchange(Vec v, int j) {
+        return j == 1 ? _mm_shuffle_epi32(v, 0xB1) : _mm_shuffle_epi32(v, 0x4E);
+    }
+    __attribute__((target("sse4.2"))) static inline Vec Mask(int lanes) {
+        Vec bits = _mm_setr_epi32(1, 2, 4, 8);
+        return _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(lanes), bits), bits);
+    }
+};
+
+struct Sse4Int64 {
+    typedef int64_t Key;
+    typedef __m128i Vec;
+    static const int LANES = 2;
+    __attribute__((target("sse4.2"))) static inline Vec Load(const Key* p) { return _mm_load_si128((const Vec*)p); }
+    __attribute__((target("sse4.2"))) static inline void Store(Key* p, Vec v) { _mm_store_si128((Vec*)p, v); }
+    __attribute__((target("sse4.2"))) static inline Vec Min(Vec a, Vec b) { return _mm_blendv_epi8(a, b, _mm_cmpgt_epi64(a, b)); }
+    __attribute__((target("sse4.2"))) static inline Vec Max(Vec a, Vec b) { return _mm_blendv_epi8(b, a, _mm_cmpgt_epi64(a, b)); }
+    __attribute__((target("sse4.2"))) static inline Vec Blend(Vec a, Vec b, Vec mask) { return _mm_blendv_epi8(a, b, mask); }
+    __attribute__((target("sse4.2"))) static inline Vec Exchange(Vec v, int) { return _mm_shuffle_epi32(v, 0x4E); }
+    __attribute__((target("sse4.2"))) static inline Vec Mask(int lanes) {
+        Vec bits = _mm_set_epi64x(2, 1);
+        return _mm_cmpeq_epi64(_mm_and_si128(_mm_set1_epi64x(lanes), bits), bits);
+    }
+};
+
+// Sorts block[0..size), size a power of two between V::LANES and SIMD_SORT_MAX, block 32-byte aligned.
+// Always inlined into the kernels below, so it is compiled for their instruction set.
+template <typename V>
+__attribute__((always_inline)) inline void BitonicNetwork(typename V::Key block[], int size) {
+    typedef typename V::Vec Vec;
+    for (int k = 2; k <= size; k <<= 1) {
+        for (int j = k >> 1; j > 0; j >>= 1) {
+            for (int b = 0; b < size; b += V::LANES) {
+                if (j >= V::LANES) {
+                    if (b & j) continue;  // handled together with block b - j
+                    Vec x = V::Load(block + b);
+                    Vec y = V::Load(block + b + j);
+                    bool descending = (b & k) != 0;
+                    V::Store(block + b, descending ? V::Max(x, y) : V::Min(x, y));
+                    V::Store(block + b + j, descending ? V::Min(x, y) : V::Max(x, y));
+                } else {
+                    int maxLanes = 0;  // lanes that keep the bigger key of their pair
+                    for (int lane = 0; lane < V::LANES; lane++) {
+                        int i = b + lane;
+                        if (((i & j) != 0) != ((i & k) != 0)) maxLanes |= 1 << lane;
+                    }
+                    Vec x = V::Load(block + b);
+                    Vec partner = V::Exchange(x, j);
+                    V::Store(block + b, V::Blend(V::Min(x, partner), V::Max(x, partner), V::Mask(maxLanes)));
+                }
+            }
+        }
     }
 }
 
+// Copies arr into a padded block, runs the network and copies the keys back
+template <typename V>
+__attribute__((always_inline)) inline void NetworkSort(typename V::Key arr[], int size) {
+    typedef typename V::Key Key;
+    alignas(32) Key block[SIMD_SORT_MAX];
+    int padded = V::LANES;
+    while (padded < size) padded <<= 1;
+    copy(arr, arr + size, block);
+    fill(block + size, block + padded, numeric_limits<Key>::max());
+    BitonicNetwork<V>(block, padded);
+    copy(block, block + size, arr);
+}
+
+__attribute__((target("avx2"))) void NetworkSortAvx2(int32_t arr[], int size) { NetworkSort<Avx2Int32>(arr, size); }
+__attribute__((target("avx2"))) void NetworkSortAvx2(int64_t arr[], int size) { NetworkSort<Avx2Int64>(arr, size); }
+__attribute__((target("sse4.2"))) void NetworkSortSse4(int32_t arr[], int size) { NetworkSort<Sse4Int32>(arr, size); }
+__attribute__((target("sse4.2"))) void NetworkSortSse4(int64_t arr[], int size) { NetworkSort<Sse4Int64>(arr, size); }
+
+#pragma GCC diagnostic pop
+#endif
+
+SimdLevel DetectSimdLevel() {
+#if SIMD_SORT_AVAILABLE
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse4.2")) return SIMD_SSE4;
+#endif
+    return SIMD_NONE;
+}
+
+const SimdLevel detectedSimdLevel = DetectSimdLevel();
+SimdLevel smallSortLevel = detectedSimdLevel;
+
+// Lets the benchmark compare kernels; it can't go above what the CPU supports
+void SetSmallSortLevel(SimdLevel level) {
+    smallSortLevel = min(level, detectedSimdLevel);
+}
+
+// Sorts arr[0..size) for size <= SIMD_SORT_MAX with the best sorting network the CPU has.
+// The networks work on a block of SIMD_SORT_MAX keys, so bigger ranges get insertion sort.
+template <typename Key>
+void SmallSort(Key arr[], int size) {
+    static_assert(is_same<Key, int32_t>::value || is_same<Key, int64_t>::value, "SmallSort sorts int32_t or int64_t keys");
+    if (size < 2) return;
+    if (size > SIMD_SORT_MAX) {
+        InsertionSortKeys(arr, size);
+        return;
+    }
+#if SIMD_SORT_AVAILABLE
+    if (smallSortLevel == SIMD_AVX2) {
+        NetworkSortAvx2(arr, size);
+        return;
+    }
+    if (smallSortLevel == SIMD_SSE4) {
+        NetworkSortSse4(arr, size);
+        return;
+    }
+#endif
+    InsertionSortKeys(arr, size);
+}
+
 // Implementing the MergeSort function;
 
 // l = left
 // m = mid
 // r = right
 
+template <typename Trace = ConsoleTrace>
 void Merge(int arr[], int l, int m, int r) {
     // Calculate sizes of two subarrays to be merged
     // n1 = size of left subarray (from left to mid inclusive)
@@ -125,24 +389,89 @@ void Merge(int arr[], int l, int m, int r) {
     }
     
     // Display after each merge
-    cout << "After merging [" << l << "-" << m << "] and [" << m+1 << "-" << r << "]: ";
-    DisplayArr(arr + l, r - l + 1);
-    cout << endl;
+    Trace::afterMerge(arr, l, m, r);
 }
 
+template <typename Trace = ConsoleTrace>
 void MergeSort(int arr[], int l, int r) {
     if (l < r) { // Check if the smaller sub array has one element only or not; (if FALSE, recursive calls stop)
         int m = (l + r)/2;
-        MergeSort(arr, l, m);
-        MergeSort(arr, m+1, r);
-        Merge(arr, l, m, r);
+        MergeSort<Trace>(arr, l, m);
+        MergeSort<Trace>(arr, m+1, r);
+        Merge<Trace>(arr, l, m, r);
+    }
+}
+
+// Bottom-up merge sort for big arrays.
+// Merge() above copies both halves into stack arrays on every call, which overflows the stack
+// for a few million elements. This version does no recursion and allocates one scratch buffer
+// of the same size as the array, once:
+// 1. Runs of MERGE_SMALL_SORT_CUTOFF elements are sorted with SmallSort.
+// 2. Each pass merges neighbouring runs of `width` elements from src into dst, then the two
+//    swap roles and the width doubles. If the sorted array ends up in the buffer, it is copied back.
+const int MERGE_SMALL_SORT_CUTOFF = 32;
+
+// Merges the sorted arrays a[0..na) and b[0..nb) into out[0..na+nb)
+void MergeSorted(const int a[], long long na, const int b[], long long nb, int out[]) {
+    long long i = 0;
+    long long j = 0;
+    long long k = 0;
+    while (i < na && j < nb) {
+        // <= keeps equal elements in their original order (stable)
+        if (a[i] <= b[j]) out[k++] = a[i++];
+        else out[k++] = b[j++];
+    }
+    while (i < na) out[k++] = a[i++];
+    while (j < nb) out[k++] = b[j++];
+}
+
+// Merges src[l..m) and src[m..r) into dst[l..r)
+void MergeRuns(const int src[], int dst[], long long l, long long m, long long r) {
+    if (m == r || src[m - 1] <= src[m]) {
+        copy(src + l, src + r, dst + l);  // already in order (or nothing to merge with)
+        return;
     }
+    MergeSorted(src + l, m - l, src + m, r - m, dst + l);
 }
 
+// Sorts arr[0..size) using buffer[0..size) as the scratch space
+template <typename Trace = ConsoleTrace>
+void BottomUpMergeSort(int arr[], long long size, int buffer[]) {
+    if (size < 2) return;
+
+    for (long long lo = 0; lo < size; lo += MERGE_SMALL_SORT_CUTOFF) {
+        SmallSort(arr + lo, (int)min<long long>(MERGE_SMALL_SORT_CUTOFF, size - lo));
+    }
+    if (size <= MERGE_SMALL_SORT_CUTOFF) return;
+
+    int* src = arr;
+    int* dst = buffer;
+    for (long long width = MERGE_SMALL_SORT_CUTOFF; width < size; width *= 2) {
+        for (long long lo = 0; lo < size; lo += 2 * width) {
+            long long mid = min(lo + width, size);
+            long long hi = min(lo + 2 * width, size);
+            MergeRuns(src, dst, lo, mid, hi);
+            Trace::afterMerge(dst, (int)lo, (int)mid - 1, (int)hi - 1);
+        }
+        swap(src, dst);
+    }
+    if (src != arr) copy(src, src + size, arr);
+}
+
+template <typename Trace = ConsoleTrace>
+void BottomUpMergeSort(int arr[], long long size) {
+    if (size <= MERGE_SMALL_SORT_CUTOFF) {
+        SmallSort(arr, (int)max<long long>(size, 0));
+        return;
+    }
+    unique_ptr<int[]> buffer(new int[size]);
+    BottomUpMergeSort<Trace>(arr, size, buffer.get());
+}
 
 // Partition function: rearranges array and places pivot in correct position
 // All elements smaller than pivot go to left, larger to right
 // Returns the final index of pivot element
+template <typename Trace = ConsoleTrace>
 int partition(int arr[], int low, int high) {
     // Choose the pivot element - using last element (arr[high])
     // Pivot selection strategy affects performance but last element is common
@@ -181,9 +510,7 @@ int partition(int arr[], int low, int high) {
     arr[high] = temp;
     
     // Display after partition
-    cout << "After partition (pivot " << pivot << " at position " << i + 1 << "): ";
-    DisplayArr(arr, high - low + 1);
-    cout << endl;
+    Trace::afterPartition(arr, low, high, pivot, i + 1);
     
     // Return pivot's final position - this index divides the array into two parts
     return i + 1;
@@ -191,35 +518,521 @@ int partition(int arr[], int low, int high) {
 
 // Main QuickSort recursive function
 // Uses divide-and-conquer strategy to sort the array
+template <typename Trace = ConsoleTrace>
 void QuickSort(int arr[], int low, int high) {
     // Base case: if low >= high, subarray has 0 or 1 element (already sorted)
     // Recursion stops when subarray size becomes 1 or empty
     if (low < high) {
         // Display current subarray being processed
-        cout << "Processing subarray: ";
-        DisplayArr(arr + low, high - low + 1);
-        cout << endl;
+        Trace::processingSubarray(arr, low, high);
         
         // Partition the array and get pivot index (pi)
         // After partition: 
         // - arr[pi] is in its final sorted position
         // - All elements left of pi are smaller
         // - All elements right of pi are larger
-        int pi = partition(arr, low, high);
+        int pi = partition<Trace>(arr, low, high);
 
         // Recursively sort elements before partition (left subarray)
         // Elements from low to pi-1 are all smaller than pivot but unsorted
-        QuickSort(arr, low, pi - 1);
+        QuickSort<Trace>(arr, low, pi - 1);
 
         // Recursively sort elements after partition (right subarray)
         // Elements from pi+1 to high are all larger than pivot but unsorted
-        QuickSort(arr, pi + 1, high);
+        QuickSort<Trace>(arr, pi + 1, high);
         
         // Note: We don't sort pi because it's already in correct position
     }
 }
 
+// Heap sort, the fallback for IntroSort below. O(n log n) on any input, no extra memory.
+// SiftDown moves arr[root] down until it is bigger than both children (max-heap).
+void SiftDown(int arr[], int root, int size) {
+    while (2 * root + 1 < size) {
+        int child = 2 * root + 1;
+        if (child + 1 < size && arr[child + 1] > arr[child]) child++;  // bigger child
+        if (arr[root] >= arr[child]) return;
+        swap(arr[root], arr[child]);
+        root = child;
+    }
+}
+
+void HeapSort(int arr[], int size) {
+    // Build the heap, then keep moving the biggest element to the end
+    for (int i = size / 2 - 1; i >= 0; i--) {
+        SiftDown(arr, i, size);
+    }
+    for (int end = size - 1; end > 0; end--) {
+        swap(arr[0], arr[end]);
+        SiftDown(arr, 0, end);
+    }
+}
+
+// Introspective QuickSort (introsort).
+// QuickSort above always takes arr[high] as the pivot, so sorted or reverse-sorted input makes
+// every partition as uneven as possible: O(n^2) time and n levels of recursion. IntroSort:
+// - picks the median of three elements (low, mid, high), or for big ranges the median of
+//   three medians of three ("ninther"), and moves it to arr[high] for partition();
+// - recurses only into the smaller side and loops on the bigger one, so the stack is at
+//   most log2(n) deep;
+// - finishes ranges of INTRO_SMALL_SORT_CUTOFF elements or fewer with SmallSort;
+// - switches a range to HeapSort once it has been partitioned 2*log2(n) times, which keeps
+//   the worst case at O(n log n).
+const int INTRO_SMALL_SORT_CUTOFF = SIMD_SORT_MAX;
+const int NINTHER_THRESHOLD = 128;
+
+// Orders arr[a] <= arr[b] <= arr[c]
+void SortThree(int arr[], int a, int b, int c) {
+    if (arr[b] < arr[a]) swap(arr[a], arr[b]);
+    if (arr[c] < arr[b]) swap(arr[b], arr[c]);
+    if (arr[b] < arr[a]) swap(arr[a], arr[b]);
+}
+
+void ChoosePivot(int arr[], int low, int high) {
+    int mid = low + (high - low) / 2;
+    if (high - low + 1 > NINTHER_THRESHOLD) {
+        int step = (high - low + 1) / 8;
+        SortThree(arr, low, low + step, low + 2 * step);
+        SortThree(arr, mid - step, mid, mid + step);
+        SortThree(arr, high - 2 * step, high - step, high);
+        SortThree(arr, low + step, mid, high - step);
+    } else {
+        SortThree(arr, low, mid, high);
+    }
+    swap(arr[mid], arr[high]);  // partition() takes the pivot from arr[high]
+}
+
+template <typename Trace = ConsoleTrace>
+void IntroSortRange(int arr[], int low, int high, int depthLimit) {
+    while (high - low + 1 > INTRO_SMALL_SORT_CUTOFF) {
+        if (depthLimit == 0) {
+            HeapSort(arr + low, high - low + 1);
+            return;
+        }
+        depthLimit--;
+
+        Trace::processingSubarray(arr, low, high);
+        ChoosePivot(arr, low, high);
+        int pi = partition<Trace>(arr, low, high);
+
+        if (pi - low < high - pi) {
+            IntroSortRange<Trace>(arr, low, pi - 1, depthLimit);
+            low = pi + 1;
+        } else {
+            IntroSortRange<Trace>(arr, pi + 1, high, depthLimit);
+            high = pi - 1;
+        }
+    }
+    SmallSort(arr + low, high - low + 1);
+}
+
+template <typename Trace = ConsoleTrace>
+void IntroSort(int arr[], int size) {
+    int depthLimit = 0;
+    for (int n = size; n > 1; n /= 2) depthLimit += 2;  // 2 * floor(log2(size))
+    IntroSortRange<Trace>(arr, 0, size - 1, depthLimit);
+}
+
+
+// LSD radix sort for integer keys of 8 to 64 bits, signed or unsigned.
+// Not a comparison sort: every pass distributes the keys by one RADIX_BITS-bit digit, lowest
+// digit first, into a buffer (counting sort, which is stable, so the order from the earlier
+// passes survives); the array and the buffer swap roles after each pass.
+// - The counts for all passes come from one pre-pass over the keys.
+// - A pass whose digit is the same for every key would just copy, so it is skipped.
+// - Signed keys get their sign bit flipped first, so negative numbers sort before positive ones.
+// - Arrays of RADIX_SMALL_SORT_CUTOFF keys or fewer are sorted with SmallSort (int32_t and
+//   int64_t) or InsertionSortKeys instead.
+// 11-bit digits need 3 passes for 32-bit keys and 6 for 64-bit ones, and one pass's counts
+// (2048 of them) still fit in the L1 cache.
+const int RADIX_BITS = 11;
+const int RADIX_BUCKETS = 1 << RADIX_BITS;
+const long long RADIX_SMALL_SORT_CUTOFF = SIMD_SORT_MAX;
+
+template <typename Key>
+void RadixSort(Key arr[], long long size) {
+    typedef typename make_unsigned<Key>::type Bits;
+    const int KEY_BITS = sizeof(Key) * 8;
+    const int PASSES = (KEY_BITS + RADIX_BITS - 1) / RADIX_BITS;
+    const Bits SIGN_FLIP = is_signed<Key>::value ? (Bits)((Bits)1 << (KEY_BITS - 1)) : 0;
+    const size_t DIGIT_MASK = RADIX_BUCKETS - 1;  // not Bits: 2047 doesn't fit in an 8-bit key
+
+    if (size <= RADIX_SMALL_SORT_CUTOFF) {
+        if constexpr (is_same<Key, int32_t>::value || is_same<Key, int64_t>::value) SmallSort(arr, (int)size);
+        else InsertionSortKeys(arr, size);
+        return;
+    }
+
+    // Counts of every digit value, for all passes at once
+    vector<long long> counts((size_t)PASSES * RADIX_BUCKETS, 0);
+    for (long long i = 0; i < size; i++) {
+        Bits bits = (Bits)arr[i] ^ SIGN_FLIP;
+        for (int pass = 0; pass < PASSES; pass++) {
+            counts[(size_t)pass * RADIX_BUCKETS + ((bits >> (pass * RADIX_BITS)) & DIGIT_MASK)]++;
+        }
+    }
+
+    unique_ptr<Key[]> buffer(new Key[size]);
+    Key* src = arr;
+    Key* dst = buffer.get();
+    for (int pass = 0; pass < PASSES; pass++) {
+        int shift = pass * RADIX_BITS;
+        long long* count = &counts[(size_t)pass * RADIX_BUCKETS];
+        if (count[(((Bits)src[0] ^ SIGN_FLIP) >> shift) & DIGIT_MASK] == size) {
+            continue;  // every key has the same digit here
+        }
+
+        // Turn the counts into the first output position of every digit value
+        long long position = 0;
+        for (int digit = 0; digit < RADIX_BUCKETS; digit++) {
+            long long digitCount = count[digit];
+            count[digit] = position;
+            position += digitCount;
+        }
+        for (long long i = 0; i < size; i++) {
+            size_t digit = (((Bits)src[i] ^ SIGN_FLIP) >> shift) & DIGIT_MASK;
+            dst[count[digit]++] = src[i];
+        }
+        swap(src, dst);
+    }
+    if (src != arr) copy(src, src + size, arr);
+}
+
+// Work-stealing thread pool for the parallel sorts.
+// Every worker has its own deque of tasks. It pushes and pops its own tasks at the back (the
+// piece it split last, still in its cache); a worker with nothing to do steals from the front
+// of another worker's deque (the oldest, biggest pieces). The thread that creates the pool is
+// worker 0. A thread waiting for a TaskGroup runs tasks meanwhile instead of blocking, so
+// nested fork/join cannot deadlock. Idle workers spin (yielding), so a pool should only live
+// as long as the sort that uses it.
+struct TaskGroup {
+    atomic<long long> pending{0};
+};
+
+thread_local int currentWorker = 0;
+
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int threadCount) : queues(threadCount), stopping(false) {
+        for (int i = 0; i < threadCount; i++) {
+            queues[i].reset(new TaskQueue());
+        }
+        currentWorker = 0;
+        for (int i = 1; i < threadCount; i++) {
+            workers.push_back(thread([this, i]() { WorkerLoop(i); }));
+        }
+    }
+
+    ~WorkStealingPool() {
+        stopping = true;
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
 
+    int Size() const { return (int)queues.size(); }
+
+    // Queues `task` on the calling worker's deque; Wait(group) returns once it has run
+    void Spawn(TaskGroup& group, function<void()> task) {
+        group.pending++;
+        TaskQueue& queue = *queues[currentWorker];
+        lock_guard<mutex> guard(queue.lock);
+        queue.tasks.push_back([&group, task]() {
+            task();
+            group.pending--;
+        });
+    }
+
+    void Wait(TaskGroup& group) {
+        while (group.pending > 0) {
+            if (!RunOneTask()) this_thread::yield();
+        }
+    }
+
+private:
+    struct TaskQueue {
+        mutex lock;
+        deque<function<void()>> tasks;
+    };
+
+    bool RunOneTask() {
+        function<void()> task;
+        int self = currentWorker;
+        {
+            // Own work first, newest end
+            TaskQueue& own = *queues[self];
+            lock_guard<mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = move(own.tasks.back());
+                own.tasks.pop_back();
+            }
+        }
+        for (int i = 1; !task && i < Size(); i++) {
+            // Steal the oldest task of the next worker that has one
+            TaskQueue& victim = *queues[(self + i) % Size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+        if (!task) return false;
+        task();
+        return true;
+    }
+
+    void WorkerLoop(int index) {
+        currentWorker = index;
+        while (!stopping) {
+            if (!RunOneTask()) this_thread::yield();
+        }
+    }
+
+    vector<unique_ptr<TaskQueue>> queues;
+    vector<thread> workers;
+    atomic<bool> stopping;
+};
+
+int DefaultThreadCount() {
+    int threads = (int)thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+// Parallel merge sort.
+// The two halves of a range are sorted as separate tasks (down to PARALLEL_SORT_CUTOFF
+// elements, which go to BottomUpMergeSort), then merged in parallel: the output is cut into
+// chunks of PARALLEL_MERGE_CHUNK elements and CoRank finds where each chunk starts in the two
+// inputs, so every chunk is merged by its own task. Each level merges between the array and
+// one scratch buffer (like BottomUpMergeSort), so nothing is copied back.
+// Not traced: the steps run on several threads at once.
+const long long PARALLEL_SORT_CUTOFF = 1 << 16;
+const long long PARALLEL_MERGE_CHUNK = 1 << 16;
+
+// How many of the first k elements of merge(a, b) come from a. Equal elements are taken from
+// a first, the same as MergeSorted, so the chunks line up exactly.
+long long CoRank(long long k, const int a[], long long na, const int b[], long long nb) {
+    long long lo = max(0LL, k - nb);
+    long long hi = min(k, na);
+    while (true) {
+        long long i = lo + (hi - lo) / 2;
+        long long j = k - i;
+        if (i < na && j > 0 && a[i] <= b[j - 1]) lo = i + 1;       // a[i] belongs in the first k
+        else if (i > 0 && j < nb && a[i - 1] > b[j]) hi = i - 1;  // b[j] belongs in the first k
+        else return i;
+    }
+}
+
+// Merges src[l..m) and src[m..r) into dst[l..r), one task per output chunk
+void ParallelMerge(WorkStealingPool& pool, const int src[], int dst[], long long l, long long m, long long r) {
+    long long total = r - l;
+    if (total <= PARALLEL_MERGE_CHUNK || src[m - 1] <= src[m]) {
+        MergeRuns(src, dst, l, m, r);
+        return;
+    }
+    const int* a = src + l;
+    const int* b = src + m;
+    long long na = m - l;
+    long long nb = r - m;
+    TaskGroup group;
+    for (long long k = 0; k < total; k += PARALLEL_MERGE_CHUNK) {
+        long long kEnd = min(k + PARALLEL_MERGE_CHUNK, total);
+        pool.Spawn(group, [=]() {
+            long long i = CoRank(k, a, na, b, nb);
+            long long iEnd = CoRank(kEnd, a, na, b, nb);
+            MergeSorted(a + i, iEnd - i, b + (k - i), (kEnd - iEnd) - (k - i), dst + l + k);
+        });
+    }
+    pool.Wait(group);
+}
+
+// Sorts arr[lo..hi). The result ends up in buffer[lo..hi) if intoBuffer, else in arr.
+void ParallelMergeSortRange(WorkStealingPool& pool, int arr[], int buffer[], long long lo, long long hi, bool intoBuffer) {
+    if (hi - lo <= PARALLEL_SORT_CUTOFF) {
+        BottomUpMergeSort<NoTrace>(arr + lo, hi - lo, buffer + lo);
+        if (intoBuffer) copy(arr + lo, arr + hi, buffer + lo);
+        return;
+    }
+
+    long long mid = lo + (hi - lo) / 2;
+    TaskGroup group;
+    pool.Spawn(group, [&]() { ParallelMergeSortRange(pool, arr, buffer, lo, mid, !intoBuffer); });
+    ParallelMergeSortRange(pool, arr, buffer, mid, hi, !intoBuffer);
+    pool.Wait(group);
+
+    // The halves are sorted in the other array; merge them into this one
+    if (intoBuffer) ParallelMerge(pool, arr, buffer, lo, mid, hi);
+    else ParallelMerge(pool, buffer, arr, lo, mid, hi);
+}
+
+void ParallelMergeSort(int arr[], long long size, int threads = 0) {
+    if (size <= PARALLEL_SORT_CUTOFF) {
+        BottomUpMergeSort<NoTrace>(arr, size);
+        return;
+    }
+    unique_ptr<int[]> buffer(new int[size]);
+    WorkStealingPool pool(threads > 0 ? threads : DefaultThreadCount());
+    ParallelMergeSortRange(pool, arr, buffer.get(), 0, size, false);
+}
+
+// Parallel sample sort.
+// partition() splits a range around one pivot; sample sort splits the whole array around
+// bucketCount - 1 pivots ("splitters") at once, so every bucket can be sorted on its own:
+// 1. Pick OVERSAMPLING random elements per bucket, sort them and take every OVERSAMPLING-th
+//    one as a splitter. More samples = buckets of more even size. A value that fills a big
+//    part of the sample shows up as the same splitter many times; repeats are dropped, and
+//    every splitter gets an "equality bucket" of its own for the elements equal to it, so
+//    all copies of that value land there instead of in one overfull bucket.
+// 2. Every thread takes one block of the array, works out each element's bucket (binary
+//    search over the splitters), remembers it and counts the elements per bucket.
+//    Bucket 2j holds the elements between splitters j - 1 and j, bucket 2j + 1 the ones equal
+//    to splitter j.
+// 3. Prefix sums of the counts give every (block, bucket) pair its spot in the buffer, so the
+//    blocks scatter their elements into the buffer without any locking.
+// 4. The buckets are sorted with IntroSort as separate tasks (equality buckets are already
+//    sorted) and copied back to the array.
+// Apart from the sample, the data crosses between cores once: the scatter in step 3.
+const long long SAMPLE_SORT_CUTOFF = 1 << 16;
+const int BUCKETS_PER_THREAD = 4;
+const int OVERSAMPLING = 32;
+
+void ParallelSampleSort(int arr[], long long size, int threads = 0) {
+    if (size <= SAMPLE_SORT_CUTOFF) {
+        IntroSort<NoTrace>(arr, (int)max<long long>(size, 0));
+        return;
+    }
+    if (threads <= 0) threads = DefaultThreadCount();
+    int bucketCount = min(threads * BUCKETS_PER_THREAD, 1 << 15);  // 2x after adding equality buckets, must fit uint16_t
+
+    // 1. Splitters
+    vector<int> sample((size_t)bucketCount * OVERSAMPLING);
+    mt19937_64 rng(size);
+    for (size_t i = 0; i < sample.size(); i++) {
+        sample[i] = arr[rng() % size];
+    }
+    IntroSort<NoTrace>(sample.data(), (int)sample.size());
+    vector<int> splitters(bucketCount - 1);
+    for (int b = 0; b < bucketCount - 1; b++) {
+        splitters[b] = sample[(size_t)(b + 1) * OVERSAMPLING];
+    }
+    splitters.erase(unique(splitters.begin(), splitters.end()), splitters.end());
+    bucketCount = 2 * (int)splitters.size() + 1;
+
+    // 2. Classify and count, one block per thread
+    WorkStealingPool pool(threads);
+    int blockCount = threads;
+    long long blockSize = (size + blockCount - 1) / blockCount;
+    vector<long long> counts((size_t)blockCount * bucketCount, 0);
+    unique_ptr<uint16_t[]> bucketOf(new uint16_t[size]);
+    TaskGroup classify;
+    for (int block = 0; block < blockCount; block++) {
+        pool.Spawn(classify, [&, block]() {
+            long long* blockCounts = &counts[(size_t)block * bucketCount];
+            long long end = min(size, (block + 1) * blockSize);
+            for (long long i = block * blockSize; i < end; i++) {
+                int j = (int)(lower_bound(splitters.begin(), splitters.end(), arr[i]) - splitters.begin());
+                int bucket = 2 * j + (j < (int)splitters.size() && splitters[j] == arr[i] ? 1 : 0);
+                bucketOf[i] = (uint16_t)bucket;
+                blockCounts[bucket]++;
+            }
+        });
+    }
+    pool.Wait(classify);
+
+    // 3. Offsets (bucket by bucket, block by block within a bucket), then scatter
+    vector<long long> bucketStart(bucketCount + 1, 0);
+    vector<long long> offsets(counts.size());
+    long long position = 0;
+    for (int bucket = 0; bucket < bucketCount; bucket++) {
+        bucketStart[bucket] = position;
+        for (int block = 0; block < blockCount; block++) {
+            offsets[(size_t)block * bucketCount + bucket] = position;
+            position += counts[(size_t)block * bucketCount + bucket];
+        }
+    }
+    bucketStart[bucketCount] = position;
+
+    unique_ptr<int[]> buffer(new int[size]);
+    TaskGroup scatter;
+    for (int block = 0; block < blockCount; block++) {
+        pool.Spawn(scatter, [&, block]() {
+            long long* next = &offsets[(size_t)block * bucketCount];
+            long long end = min(size, (block + 1) * blockSize);
+            for (long long i = block * blockSize; i < end; i++) {
+                buffer[next[bucketOf[i]]++] = arr[i];
+            }
+        });
+    }
+    pool.Wait(scatter);
+
+    // 4. Sort every bucket and put it back
+    TaskGroup sortBuckets;
+    for (int bucket = 0; bucket < bucketCount; bucket++) {
+        pool.Spawn(sortBuckets, [&, bucket]() {
+            long long begin = bucketStart[bucket];
+            long long end = bucketStart[bucket + 1];
+            if (bucket % 2 == 0) IntroSort<NoTrace>(buffer.get() + begin, (int)(end - begin));
+            copy(buffer.get() + begin, buffer.get() + end, arr + begin);
+        });
+    }
+    pool.Wait(sortBuckets);
+}
+
+// Benchmark: runs every sort with tracing compiled out on the same arrays (random, already
+// sorted and reverse sorted) and checks the results. The O(n^2) sorts are skipped for arrays
+// bigger than QUADRATIC_LIMIT (QuickSort too, for the sorted inputs), and the recursive
+// MergeSort (stack arrays) for arrays bigger than STACK_MERGE_LIMIT.
+const int QUADRATIC_LIMIT = 20000;
+const int STACK_MERGE_LIMIT = 1 << 20;
+
+template <typename Sort>
+void TimeSort(const char* name, const vector<int>& input, Sort sort) {
+    vector<int> arr = input;
+    auto start = chrono::steady_clock::now();
+    sort(arr.data(), (int)arr.size());
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << name << ": " << ms << " ms" << (is_sorted(arr.begin(), arr.end()) ? "" : "  (NOT SORTED!)") << endl;
+}
+
+void BenchmarkSorts(int size) {
+    vector<int> input(size);
+    mt19937 rng(42);
+    for (int i = 0; i < size; i++) {
+        input[i] = (int)rng();
+    }
+
+    cout << "(parallel sorts use " << DefaultThreadCount() << " threads, small blocks are sorted with "
+         << simdLevelNames[detectedSimdLevel] << ")" << endl;
+    const char* patterns[3] = {"Random", "Sorted", "Reverse sorted"};
+    for (int pattern = 0; pattern < 3; pattern++) {
+        if (pattern == 1) sort(input.begin(), input.end());
+        if (pattern == 2) reverse(input.begin(), input.end());
+        cout << patterns[pattern] << " input:" << endl;
+
+        if (size <= QUADRATIC_LIMIT) {
+            TimeSort("Bubble Sort", input, [](int arr[], int n) { BubbleSort<NoTrace>(arr, n); });
+            TimeSort("Insertion Sort", input, [](int arr[], int n) { InsertionSort<NoTrace>(arr, n); });
+            TimeSort("Selection Sort", input, [](int arr[], int n) { SelectionSort<NoTrace>(arr, n); });
+        }
+        if (size <= STACK_MERGE_LIMIT) {
+            TimeSort("Merge Sort", input, [](int arr[], int n) { MergeSort<NoTrace>(arr, 0, n - 1); });
+        }
+        TimeSort("Bottom-up Merge Sort", input, [](int arr[], int n) { BottomUpMergeSort<NoTrace>(arr, n); });
+        if (pattern == 0 || size <= QUADRATIC_LIMIT) {
+            TimeSort("Quick Sort", input, [](int arr[], int n) { QuickSort<NoTrace>(arr, 0, n - 1); });
+        }
+        TimeSort("Parallel Merge Sort", input, [](int arr[], int n) { ParallelMergeSort(arr, n); });
+        TimeSort("Parallel Sample Sort", input, [](int arr[], int n) { ParallelSampleSort(arr, n); });
+        TimeSort("Radix Sort (LSD)", input, [](int arr[], int n) { RadixSort(arr, (long long)n); });
+        TimeSort("IntroSort", input, [](int arr[], int n) { IntroSort<NoTrace>(arr, n); });
+        if (detectedSimdLevel != SIMD_NONE) {
+            SetSmallSortLevel(SIMD_NONE);
+            TimeSort("IntroSort (scalar base case)", input, [](int arr[], int n) { IntroSort<NoTrace>(arr, n); });
+            SetSmallSortLevel(detectedSimdLevel);
+        }
+        TimeSort("std::sort", input, [](int arr[], int n) { sort(arr, arr + n); });
+        cout << endl;
+    }
+}
 
 void DisplayInterface() {
     int arr[5] = {9, 4, 7, 1, 3};
@@ -229,7 +1042,8 @@ void DisplayInterface() {
     cout << "3. Selection Sort" << endl;
     cout << "4. Merge Sort" << endl;
     cout << "5. Quick Sort" << endl;
-    cout << "6. Exit" << endl;
+    cout << "6. Benchmark (no tracing)" << endl;
+    cout << "7. Exit" << endl;
     cout << "Enter your choice = ";
     int userChoice;
     cin >> userChoice;
@@ -286,7 +1100,15 @@ void DisplayInterface() {
             DisplayArr(arr, size);
             break;
 
-        case 6:
+        case 6: {
+            int benchSize;
+            cout << "Enter array size = ";
+            cin >> benchSize;
+            BenchmarkSorts(benchSize);
+            break;
+        }
+
+        case 7:
             cout << "Thank you for using this Sorting Program!" << endl;
             exit(0);
             break;
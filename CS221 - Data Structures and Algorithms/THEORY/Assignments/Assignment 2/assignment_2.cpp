@@ -1,331 +1,2852 @@
 #include <iostream>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string_view>
+#include <cstdint>
+#include <climits>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <new>
+#include <iterator>
+#include <charconv>
+#include <memory_resource>
+#include <unordered_set>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SIMD_SCAN_AVAILABLE 1
+#else
+#define SIMD_SCAN_AVAILABLE 0
+#endif
 using namespace std;
 
+// The fields are ordered so there is no padding between them: the ones every list walk reads
+// come first, and the whole node is 48 bytes (4 nodes in 3 cache lines).
 struct SuperBlock {
-    int Blockid;
-    int startIndex;
-    int sizeOfMemoryBlock;
-    string data;
+    long long startIndex;
+    long long sizeOfMemoryBlock;
     SuperBlock* next; // A pointer to the next superblock in the linked list
+    SuperBlock* prev; // A pointer to the previous one, so a block can be unlinked without a search
+    int Blockid;
+    int arenaIndex;   // Which arena the cells belong to (never changes)
+    short buddyOrder; // Buddy mode only: the block reserved for it has 2^buddyOrder cells (-1 otherwise)
+    bool pinned;      // someone holds a pointer into it (SuperBlockResource), so it must never move
+    int originId;     // Blockid of the allocation this block was split from (its own id if it never was)
 
-     SuperBlock(int start, int sz) 
-        : Blockid(0), startIndex(start), sizeOfMemoryBlock(sz), data(""), next(nullptr) {}
+     SuperBlock(long long start, long long sz) 
+        : startIndex(start), sizeOfMemoryBlock(sz), next(nullptr), prev(nullptr), Blockid(0), arenaIndex(0), buddyOrder(-1),
+          pinned(false), originId(0) {}
 
 };
+static_assert(sizeof(SuperBlock) <= 48, "SuperBlock should stay within 48 bytes");
 
 // Global memory pool - accessible to all functions
-char memoryPool[64]; 
+// The size is chosen at startup, so the cells live in a mapping instead of a fixed array.
+char* memoryPool = NULL;
+long long poolSize = 0;
 
-// Global variables for management
-SuperBlock* head = NULL;  // Head of linked list
-SuperBlock* tail = NULL;
-int nextBlockId = 1;         // For generating unique BlockIds
+// When false, the allocator functions don't print anything (used when running many threads)
+bool verboseOutput = true;
 
- void initializeMemoryPool() {
-        // Each building block represents one character.
-        for (int i = 0; i < 64; i++) {
-          memoryPool[i] = 'E';
+// How free space is managed. Chosen once at startup, before the pool is initialized.
+enum AllocatorMode {
+    EXTENT_MODE,  // free runs of any length, placed by placementPolicy (default)
+    BUDDY_MODE    // power-of-two blocks that are split on allocation and merged with their buddy on free
+};
+AllocatorMode allocatorMode = EXTENT_MODE;
+
+#ifdef _WIN32
+// Windows doesn't overcommit: committing a range charges all of it against the commit limit
+// right away, even if it is never touched. So reserveZeroedMemory only reserves the range,
+// and the first access to a page faults into commitOnFirstTouch, which commits the
+// LAZY_COMMIT_CHUNK around it (zero-filled) and lets the access run again.
+struct LazyRegion {
+    char* begin;  // NULL = free slot
+    char* end;
+};
+const int MAX_LAZY_REGIONS = 8;
+const long long LAZY_COMMIT_CHUNK = 64 * 1024;  // the allocation granularity, so region starts are aligned to it
+LazyRegion lazyRegions[MAX_LAZY_REGIONS];
+mutex lazyRegionLock;  // taken to add or remove a region; the handler only reads
+
+LONG CALLBACK commitOnFirstTouch(EXCEPTION_POINTERS* info) {
+    EXCEPTION_RECORD* record = info->ExceptionRecord;
+    if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION || record->NumberParameters < 2) {
+        return EXCEPTION_CONTINUE_SEARCH;
+    }
+    char* address = (char*)record->ExceptionInformation[1];
+    for (int i = 0; i < MAX_LAZY_REGIONS; i++) {
+        char* begin = lazyRegions[i].begin;
+        if (begin == NULL || address < begin || address >= lazyRegions[i].end) continue;
+        char* chunk = begin + (address - begin) / LAZY_COMMIT_CHUNK * LAZY_COMMIT_CHUNK;
+        SIZE_T length = (SIZE_T)min<long long>(LAZY_COMMIT_CHUNK, lazyRegions[i].end - chunk);
+        // Committing a page that another thread committed meanwhile is fine, it stays as it is
+        if (VirtualAlloc(chunk, length, MEM_COMMIT, PAGE_READWRITE) == NULL) return EXCEPTION_CONTINUE_SEARCH;
+        return EXCEPTION_CONTINUE_EXECUTION;
+    }
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+#endif
+
+// Reserves `bytes` of zero-filled memory straight from the OS.
+// The mapping is anonymous and lazily committed: the OS hands out zero-filled pages only
+// when a byte is first touched, so even several GB cost nothing up front and the parts
+// nobody touched never show up in the process' memory usage.
+void* reserveZeroedMemory(long long bytes) {
+#ifdef _WIN32
+    lock_guard<mutex> guard(lazyRegionLock);
+    static PVOID handler = AddVectoredExceptionHandler(1, commitOnFirstTouch);
+    for (int i = 0; handler != NULL && i < MAX_LAZY_REGIONS; i++) {
+        if (lazyRegions[i].begin != NULL) continue;
+        char* memory = (char*)VirtualAlloc(NULL, (SIZE_T)bytes, MEM_RESERVE, PAGE_READWRITE);
+        if (memory == NULL) return NULL;
+        lazyRegions[i].end = memory + bytes;
+        lazyRegions[i].begin = memory;
+        return memory;
+    }
+    // No slot left (or no handler): commit it all now
+    return VirtualAlloc(NULL, (SIZE_T)bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+    void* mapping = mmap(NULL, (size_t)bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED) return NULL;
+    return mapping;
+#endif
+}
+
+void releaseZeroedMemory(void* memory, long long bytes) {
+    if (memory == NULL) return;
+#ifdef _WIN32
+    {
+        lock_guard<mutex> guard(lazyRegionLock);
+        for (int i = 0; i < MAX_LAZY_REGIONS; i++) {
+            if (lazyRegions[i].begin == (char*)memory) lazyRegions[i].begin = NULL;
         }
-        // At the beginning, all blocks will be marked as 'E' for empty.
     }
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, (size_t)bytes);
+#endif
+}
 
-    // There is a size of the memory block, and initially the size of the memory block is 64, which is initialized.
+// Zeroes [memory, memory + bytes) page by page, skipping pages that are zero already.
+// Reading a page that was never written doesn't commit it, so those stay free.
+void clearWrittenPages(char* memory, long long bytes) {
+    static const char zeroPage[4096] = {0};
+    for (long long offset = 0; offset < bytes; offset += sizeof(zeroPage)) {
+        size_t length = (size_t)min<long long>(sizeof(zeroPage), bytes - offset);
+        if (memcmp(memory + offset, zeroPage, length) != 0) memset(memory + offset, 0, length);
+    }
+}
 
-int findAvailableBlock(int size) {
-    int currentStart = -1;  // Track start of current free sequence
-    int currentLength = 0;  // Track length of current free sequence
-    
-    for (int i = 0; i < 64; i++) {
-        if (memoryPool[i] == 'E') {
-            // If this is the start of a new free sequence
-            if (currentStart == -1) {
-                currentStart = i;  // Mark the start
+// A super-block's string lives only in memoryPool; the SuperBlock itself just knows
+// where it starts and how long it is. This returns a view of those cells (no copy).
+string_view getSuperBlockData(const SuperBlock* block) {
+    return string_view(memoryPool + block->startIndex, (size_t)block->sizeOfMemoryBlock);
+}
+
+// Occupancy bitmap: one bit per cell, 1 = occupied, 0 = free.
+// This is the only record of which cells are in use - the pool itself just holds the
+// characters, so freeing a block never has to write into memoryPool.
+// Bits past the end of the pool are set to 1 so no free run ever runs off the end.
+uint64_t* occupancyBitmap = NULL;
+long long bitmapWordCount = 0;
+
+bool isCellOccupied(long long index) {
+    return (occupancyBitmap[index >> 6] >> (index & 63)) & 1;
+}
+
+// Sets or clears the bits for [start, start + length), a whole word at a time where possible
+void setOccupancy(long long start, long long length, bool occupied) {
+    long long end = start + length;
+    while (start < end) {
+        long long word = start >> 6;
+        int bit = (int)(start & 63);
+        long long count = end - start < 64 - bit ? end - start : 64 - bit;
+        uint64_t mask = count == 64 ? ~0ULL : ((1ULL << count) - 1) << bit;
+        if (occupied) occupancyBitmap[word] |= mask;
+        else occupancyBitmap[word] &= ~mask;
+        start += count;
+    }
+}
+
+#if SIMD_SCAN_AVAILABLE
+// Compiled for AVX2 on its own, so the rest of the program still runs on CPUs without it;
+// skipFullWords only calls it when the CPU has AVX2 (checked once at startup).
+__attribute__((target("avx2"))) long long skipFullWordsAvx2(long long word, long long lastWord) {
+    const __m256i allOnes = _mm256_set1_epi64x(-1);
+    while (word + 4 <= lastWord) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(occupancyBitmap + word));
+        if (!_mm256_testc_si256(chunk, allOnes)) break;  // some bit in these 4 words is 0
+        word += 4;
+    }
+    return word;
+}
+
+bool detectAvx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+const bool cpuHasAvx2 = detectAvx2();
+#endif
+
+// Returns the first word in [word, lastWord) that is not completely occupied, or lastWord.
+// With AVX2 four words (256 cells) are compared per step.
+long long skipFullWords(long long word, long long lastWord) {
+#if SIMD_SCAN_AVAILABLE
+    if (cpuHasAvx2) word = skipFullWordsAvx2(word, lastWord);
+#endif
+    while (word < lastWord && occupancyBitmap[word] == ~0ULL) {
+        word++;
+    }
+    return word;
+}
+
+// First fit over the bitmap: returns the lowest start index in [from, to) of a free
+// run with at least `size` cells, or -1. Instead of looking at one cell at a time it
+// looks at 64 cells (one word) at a time and uses count-trailing-zeros to jump straight
+// to the first free / first occupied cell inside a word.
+// `to` must be a multiple of 64 or the end of the pool (arena boundaries always are).
+long long findFreeRunInBitmap(long long size, long long from, long long to) {
+    long long lastWord = (to + 63) >> 6;
+    long long position = from;
+    while (position < to) {
+        // Find the next free cell (a 0 bit) at or after position
+        long long word = position >> 6;
+        uint64_t freeBits = ~occupancyBitmap[word] & (~0ULL << (position & 63));
+        while (freeBits == 0) {
+            word = skipFullWords(word + 1, lastWord);
+            if (word >= lastWord) return -1;
+            freeBits = ~occupancyBitmap[word];
+        }
+        long long runStart = (word << 6) + __builtin_ctzll(freeBits);
+
+        // Find where this free run ends (the next 1 bit), but stop as soon as it is long enough
+        word = runStart >> 6;
+        uint64_t usedBits = occupancyBitmap[word] & (~0ULL << (runStart & 63));
+        while (usedBits == 0) {
+            word++;
+            if ((word << 6) - runStart >= size) return runStart;
+            if (word >= lastWord) return -1;  // run reaches the end of the range and is too short
+            usedBits = occupancyBitmap[word];
+        }
+        long long runEnd = (word << 6) + __builtin_ctzll(usedBits);
+        if (runEnd - runStart >= size) return runStart;
+
+        position = runEnd;  // too short - continue after it
+    }
+    return -1;
+}
+
+// Arenas: the pool is cut into a few contiguous regions, and each thread allocates from
+// its own region, so threads don't fight over one lock. Each arena has its own free-extent
+// index, its own list of super-blocks and its own lock. Arena boundaries are multiples of
+// 64 cells so that two arenas never share a word of the occupancy bitmap.
+// With a single arena (the default) this is exactly the old single-pool allocator.
+struct Arena {
+    int index;        // position in `arenas`
+    long long begin;  // first cell of the arena
+    long long end;    // one past the last cell
+
+    // Free-extent index: every run of free cells is stored twice.
+    // freeExtentsBySize is ordered by (length, startIndex), so the smallest run that fits
+    // a request is found with one lower_bound in O(log n).
+    // freeExtentsByStart is ordered by startIndex, so when memory is freed we can find the
+    // runs right before and right after it and merge them into one bigger run.
+    set<pair<long long, long long>> freeExtentsBySize;  // (length, startIndex)
+    map<long long, long long> freeExtentsByStart;       // startIndex -> length
+    long long freeCellCount;                            // total of all free runs
+
+    // Buddy mode: buddyFreeLists[k] holds the offsets (from `begin`) of the free blocks
+    // of 2^k cells. A block of 2^k cells always starts at a multiple of 2^k.
+    vector<set<long long>> buddyFreeLists;
+    long long internalWaste;  // cells reserved by live buddy blocks that hold no payload
+
+    long long nextFitCursor;  // next fit: where the last search stopped
+
+    // Telemetry counters (only ever changed under `lock`, so they cost one add each)
+    long long liveBlocks;        // super-blocks in the list
+    long long freeRunSplits;     // a free run / buddy block was cut to serve an allocation
+    long long freeRunMerges;     // a freed range / buddy block was joined with a free neighbour
+    long long superBlockSplits;  // a super-block was split in two by a middle deallocation
+    long long superBlockMerges;  // two parts of a split super-block were joined again
+
+    // Linked list of the super-blocks that live in this arena
+    SuperBlock* head;  // Head of linked list
+    SuperBlock* tail;
+
+    // Address index: the same blocks ordered by startIndex, so compaction can find the block
+    // that sits right after a free run.
+    map<long long, SuperBlock*> blocksByAddress;
+
+    mutex lock;  // guards everything above (and this arena's part of the bitmap)
+
+    // Cross-thread free queue: blocks freed by a thread that doesn't own this arena are
+    // parked here and really freed by the next thread that takes `lock`.
+    mutex remoteFreeLock;
+    vector<SuperBlock*> remoteFrees;
+
+    // Node pool: SuperBlocks are carved out of slabs that belong to the arena, and a freed
+    // node goes onto spareNodes (linked through `next`) instead of back to the heap.
+    // Guarded by `lock` like the list itself. The slabs are released with the arena.
+    SuperBlock* spareNodes;
+    vector<SuperBlock*> nodeSlabs;
+
+    Arena(int position, long long first, long long last)
+        : index(position), begin(first), end(last), freeCellCount(0), internalWaste(0), nextFitCursor(first),
+          liveBlocks(0), freeRunSplits(0), freeRunMerges(0), superBlockSplits(0), superBlockMerges(0), head(NULL), tail(NULL),
+          spareNodes(NULL) {}
+
+    ~Arena() {
+        for (size_t i = 0; i < nodeSlabs.size(); i++) {
+            ::operator delete(nodeSlabs[i], align_val_t(64));
+        }
+    }
+};
+
+vector<Arena*> arenas;
+
+const int SUPERBLOCK_SLAB_NODES = 256;  // nodes per slab (12 KB, cache-line aligned)
+
+// Takes a node from the arena's pool (a new slab when the pool is empty). The caller holds arena.lock.
+SuperBlock* newSuperBlock(Arena& arena, long long start, long long size) {
+    if (arena.spareNodes == NULL) {
+        SuperBlock* slab = (SuperBlock*)::operator new(sizeof(SuperBlock) * SUPERBLOCK_SLAB_NODES, align_val_t(64));
+        arena.nodeSlabs.push_back(slab);
+        for (int i = SUPERBLOCK_SLAB_NODES - 1; i >= 0; i--) {
+            slab[i].next = arena.spareNodes;
+            arena.spareNodes = &slab[i];
+        }
+    }
+    SuperBlock* node = arena.spareNodes;
+    arena.spareNodes = node->next;
+    return new (node) SuperBlock(start, size);
+}
+
+// Puts an unlinked node back into the arena's pool. The caller holds arena.lock.
+void recycleSuperBlock(Arena& arena, SuperBlock* block) {
+    block->next = arena.spareNodes;
+    arena.spareNodes = block;
+}
+
+// Id table: maps every live Blockid to its SuperBlock, so the deallocate functions
+// find a block in O(1) instead of walking a list.
+// It is split into shards with their own locks, so threads freeing different ids rarely wait.
+// Every node that enters a list must be registered here, and every node that leaves must be erased.
+// Lock order: an arena lock may be held while taking a shard lock, never the other way round.
+const int BLOCK_TABLE_SHARDS = 64;
+
+struct BlockTableShard {
+    mutex lock;
+    unordered_map<int, SuperBlock*> blocks;
+};
+BlockTableShard blockTable[BLOCK_TABLE_SHARDS];
+
+BlockTableShard& blockTableShard(int BlockId) {
+    return blockTable[(unsigned)BlockId % BLOCK_TABLE_SHARDS];
+}
+
+// Blockids stay globally unique: each thread grabs a batch of ids from the shared counter
+// and hands them out one by one, so the counter is touched once per BLOCK_ID_BATCH blocks.
+const int BLOCK_ID_BATCH = 1024;
+atomic<int> nextBlockId(1);  // For generating unique BlockIds (start of the next free batch)
+thread_local int threadNextBlockId = 0;
+thread_local int threadLastBlockId = -1;
+
+int takeNextBlockId() {
+    if (threadNextBlockId > threadLastBlockId) {
+        threadNextBlockId = nextBlockId.fetch_add(BLOCK_ID_BATCH);
+        threadLastBlockId = threadNextBlockId + BLOCK_ID_BATCH - 1;
+    }
+    return threadNextBlockId++;
+}
+
+// Every thread is given a slot the first time it allocates; slot % arena count is its home arena
+atomic<int> nextThreadSlot(0);
+thread_local int threadSlot = -1;
+
+int homeArenaIndex() {
+    if (threadSlot == -1) threadSlot = nextThreadSlot++;
+    return threadSlot % (int)arenas.size();
+}
+
+// Latency histograms: for every kind of operation, bucket i counts the calls that took
+// between 2^i and 2^(i+1) - 1 nanoseconds. Each thread writes only to its own histograms
+// (no shared cache lines, no locked instructions); reading the stats adds them all up.
+enum OperationKind {
+    OP_ALLOCATE,
+    OP_FREE,
+    OP_PARTIAL_FREE,
+    OP_BATCH_ALLOCATE,
+    OP_BATCH_FREE,
+    OP_COMPACT,
+    OP_RESIZE,
+    OPERATION_KINDS
+};
+const char* operationNames[OPERATION_KINDS] = {
+    "allocate", "free", "partial_free", "batch_allocate", "batch_free", "compact", "resize"
+};
+const int LATENCY_BUCKETS = 40;
+
+struct LatencyHistograms {
+    atomic<unsigned long long> counts[OPERATION_KINDS][LATENCY_BUCKETS];
+};
+
+bool telemetryEnabled = true;  // --no-telemetry turns the latency timers off
+mutex histogramRegistryLock;
+vector<LatencyHistograms*> histogramRegistry;  // one per thread that ever recorded, never freed
+thread_local LatencyHistograms* threadHistograms = NULL;
+
+void recordLatency(OperationKind op, long long nanoseconds) {
+    if (threadHistograms == NULL) {
+        threadHistograms = new LatencyHistograms();
+        for (int k = 0; k < OPERATION_KINDS; k++)
+            for (int b = 0; b < LATENCY_BUCKETS; b++)
+                threadHistograms->counts[k][b].store(0);
+        lock_guard<mutex> guard(histogramRegistryLock);
+        histogramRegistry.push_back(threadHistograms);
+    }
+
+    int bucket = nanoseconds <= 1 ? 0 : 63 - __builtin_clzll((unsigned long long)nanoseconds);
+    if (bucket >= LATENCY_BUCKETS) bucket = LATENCY_BUCKETS - 1;
+
+    // Only this thread writes here, so a plain load + store is enough
+    atomic<unsigned long long>& count = threadHistograms->counts[op][bucket];
+    count.store(count.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// Allocation traces: with --record every successful allocate, free, partial free and split,
+// and every compaction and the merges it does, is appended to a binary file as one fixed-size record, so real
+// traffic can be replayed later against other placement policies (see replayTrace). Block ids are the ids the recording run
+// handed out; the replay maps them to its own ids. Offsets are relative to the block's start,
+// so it doesn't matter where the replay happens to place a block.
+enum TraceOp {
+    TRACE_ALLOCATE = 1,     // blockId, size = string length
+    TRACE_FREE,             // blockId
+    TRACE_FREE_FROM_START,  // blockId, size = part size
+    TRACE_FREE_ANYWHERE,    // blockId, offset, size; newBlockId = second half if it was split
+    TRACE_RESIZE,           // blockId, size = new size
+    TRACE_COMPACT,          // size = byte budget; offset = arena an allocation compacted, -1 = whole pool
+    TRACE_MERGE             // blockId = retired part, newBlockId = the earlier part it was joined into
+};
+
+#pragma pack(push, 1)
+struct TraceHeader {
+    char magic[4];  // "SBTR"
+    uint32_t version;
+    int64_t poolSize;
+    int32_t arenaCount;
+    uint8_t buddyMode;
+};
+
+struct TraceRecord {  // 25 bytes
+    uint8_t op;
+    int32_t blockId;
+    int32_t newBlockId;
+    int64_t offset;
+    int64_t size;
+};
+#pragma pack(pop)
+
+const uint32_t TRACE_VERSION = 2;  // version 1 traces have no TRACE_COMPACT / TRACE_MERGE and still replay
+ofstream traceFile;  // only open while recording
+mutex traceLock;
+
+bool startTraceRecording(const string &path, long long size, int arenaCount) {
+    traceFile.open(path, ios::binary | ios::trunc);
+    if (!traceFile) {
+        cout << "Error: Could not open trace file '" << path << "'" << endl;
+        return false;
+    }
+    TraceHeader header = {{'S', 'B', 'T', 'R'}, TRACE_VERSION, size, arenaCount,
+                          (uint8_t)(allocatorMode == BUDDY_MODE)};
+    traceFile.write((const char*)&header, sizeof(header));
+    return true;
+}
+
+void recordTraceEvent(TraceOp op, int BlockId, int newBlockId, long long offset, long long size) {
+    if (!traceFile.is_open()) return;
+    TraceRecord record = {(uint8_t)op, BlockId, newBlockId, offset, size};
+    lock_guard<mutex> guard(traceLock);
+    traceFile.write((const char*)&record, sizeof(record));
+}
+
+// Times the enclosing function: put one at the top and it records when the function returns
+struct LatencyTimer {
+    OperationKind op;
+    chrono::steady_clock::time_point start;
+
+    LatencyTimer(OperationKind kind) : op(kind) {
+        if (telemetryEnabled) start = chrono::steady_clock::now();
+    }
+    ~LatencyTimer() {
+        if (!telemetryEnabled) return;
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+        recordLatency(op, chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+    }
+};
+
+// Looks up a block by its id, returns NULL if there is no such block
+SuperBlock* findSuperBlock(int BlockId) {
+    BlockTableShard& shard = blockTableShard(BlockId);
+    lock_guard<mutex> guard(shard.lock);
+    unordered_map<int, SuperBlock*>::iterator it = shard.blocks.find(BlockId);
+    if (it == shard.blocks.end()) return NULL;
+    return it->second;
+}
+
+// Returns the arena of a block, or -1 if there is no such block.
+// Read under the shard lock: a block is only deleted after it has left the table.
+int findSuperBlockArena(int BlockId) {
+    BlockTableShard& shard = blockTableShard(BlockId);
+    lock_guard<mutex> guard(shard.lock);
+    unordered_map<int, SuperBlock*>::iterator it = shard.blocks.find(BlockId);
+    if (it == shard.blocks.end()) return -1;
+    return it->second->arenaIndex;
+}
+
+// Removes a block from the id table and returns it, or NULL if it was not there.
+// Whoever takes a block out of the table is the one who gets to free it.
+SuperBlock* takeSuperBlock(int BlockId) {
+    BlockTableShard& shard = blockTableShard(BlockId);
+    lock_guard<mutex> guard(shard.lock);
+    unordered_map<int, SuperBlock*>::iterator it = shard.blocks.find(BlockId);
+    if (it == shard.blocks.end()) return NULL;
+    SuperBlock* block = it->second;
+    shard.blocks.erase(it);
+    return block;
+}
+
+// Adds a freshly linked node to the id table and the arena's address index
+void registerSuperBlock(Arena& arena, SuperBlock* block) {
+    arena.blocksByAddress[block->startIndex] = block;
+    arena.liveBlocks++;
+    BlockTableShard& shard = blockTableShard(block->Blockid);
+    lock_guard<mutex> guard(shard.lock);
+    shard.blocks[block->Blockid] = block;
+}
+
+// Changes where a block starts and keeps the address index up to date
+void setSuperBlockStart(Arena& arena, SuperBlock* block, long long newStart) {
+    arena.blocksByAddress.erase(block->startIndex);
+    block->startIndex = newStart;
+    arena.blocksByAddress[newStart] = block;
+}
+
+// Removes a node from the arena's linked list and address index (does not delete it,
+// and does not touch the id table - the caller has already taken it out of there)
+void unlinkSuperBlock(Arena& arena, SuperBlock* block) {
+    if (block->prev != NULL) block->prev->next = block->next;
+    else arena.head = block->next;   // Deleting the head node
+
+    if (block->next != NULL) block->next->prev = block->prev;
+    else arena.tail = block->prev;   // Deleting the tail node
+
+    block->next = block->prev = NULL;
+    arena.blocksByAddress.erase(block->startIndex);
+    arena.liveBlocks--;
+}
+
+// Adds the free run [start, start + length) to the index, merging it with its neighbours
+void addFreeExtent(Arena& arena, long long start, long long length) {
+    if (length <= 0) return;
+
+    map<long long, long long>::iterator after = arena.freeExtentsByStart.lower_bound(start);
+
+    // Merge with the run that ends exactly where this one starts
+    if (after != arena.freeExtentsByStart.begin()) {
+        map<long long, long long>::iterator before = after;
+        before--;
+        if (before->first + before->second == start) {
+            arena.freeRunMerges++;
+            start = before->first;
+            length += before->second;
+            arena.freeExtentsBySize.erase(make_pair(before->second, before->first));
+            arena.freeExtentsByStart.erase(before);
+        }
+    }
+
+    // Merge with the run that starts exactly where this one ends
+    if (after != arena.freeExtentsByStart.end() && after->first == start + length) {
+        arena.freeRunMerges++;
+        length += after->second;
+        arena.freeExtentsBySize.erase(make_pair(after->second, after->first));
+        arena.freeExtentsByStart.erase(after);
+    }
+
+    arena.freeExtentsByStart[start] = length;
+    arena.freeExtentsBySize.insert(make_pair(length, start));
+}
+
+// Marks [start, start + length) as free and counts it
+void addFreeCells(Arena& arena, long long start, long long length) {
+    if (length <= 0) return;
+    addFreeExtent(arena, start, length);
+    setOccupancy(start, length, false);
+    arena.freeCellCount += length;
+}
+
+// Removes [start, start + length) from the free run that contains it.
+// Whatever is left of that run on either side goes back into the index.
+void removeFreeRange(Arena& arena, long long start, long long length) {
+    if (length <= 0) return;
+
+    map<long long, long long>::iterator run = arena.freeExtentsByStart.upper_bound(start);
+    if (run == arena.freeExtentsByStart.begin()) return;  // no free run contains start
+    run--;
+
+    long long runStart = run->first;
+    long long runLength = run->second;
+    if (runStart + runLength < start + length) return;  // range is not entirely free
+
+    arena.freeExtentsBySize.erase(make_pair(runLength, runStart));
+    arena.freeExtentsByStart.erase(run);
+    setOccupancy(start, length, true);
+    arena.freeCellCount -= length;
+    if (runLength != length) arena.freeRunSplits++;
+
+    // Left-over piece before the range
+    if (start > runStart) {
+        arena.freeExtentsByStart[runStart] = start - runStart;
+        arena.freeExtentsBySize.insert(make_pair(start - runStart, runStart));
+    }
+    // Left-over piece after the range
+    long long rangeEnd = start + length;
+    long long runEnd = runStart + runLength;
+    if (runEnd > rangeEnd) {
+        arena.freeExtentsByStart[rangeEnd] = runEnd - rangeEnd;
+        arena.freeExtentsBySize.insert(make_pair(runEnd - rangeEnd, rangeEnd));
+    }
+}
+
+// Buddy allocator, used instead of the free-extent index in BUDDY_MODE.
+// A request for n cells gets a block of the next power of two. Bigger free blocks are split
+// in half until the size is right; on free, a block is merged with its buddy (the other half
+// of the block it was split from) for as long as that buddy is free too. Both walk at most
+// one step per order, so allocation and freeing are O(log n).
+const int BUDDY_MAX_ORDER = 62;
+
+// Smallest k with 2^k >= size
+int buddyOrderFor(long long size) {
+    int order = 0;
+    while ((1LL << order) < size) order++;
+    return order;
+}
+
+// Cuts the whole arena into free buddy blocks. If the arena size isn't a power of two it is
+// split into one block per set bit, biggest first, so every block is aligned to its size.
+void initializeBuddyArena(Arena& arena) {
+    arena.buddyFreeLists.assign(BUDDY_MAX_ORDER + 1, set<long long>());
+    long long size = arena.end - arena.begin;
+    long long offset = 0;
+    for (int order = BUDDY_MAX_ORDER; order >= 0; order--) {
+        if (size & (1LL << order)) {
+            arena.buddyFreeLists[order].insert(offset);
+            offset += 1LL << order;
+        }
+    }
+    arena.freeCellCount = size;
+}
+
+// Takes a free block of 2^order cells out of the arena, returns its start index or -1
+long long buddyAllocate(Arena& arena, int order) {
+    int current = order;
+    while (current <= BUDDY_MAX_ORDER && arena.buddyFreeLists[current].empty()) current++;
+    if (current > BUDDY_MAX_ORDER) return -1;
+
+    long long offset = *arena.buddyFreeLists[current].begin();
+    arena.buddyFreeLists[current].erase(arena.buddyFreeLists[current].begin());
+
+    // Split: keep the lower half, the upper half becomes a free block one order smaller
+    while (current > order) {
+        current--;
+        arena.buddyFreeLists[current].insert(offset + (1LL << current));
+        arena.freeRunSplits++;
+    }
+
+    arena.freeCellCount -= 1LL << order;
+    return arena.begin + offset;
+}
+
+// Gives a block of 2^order cells back and merges it with its free buddies
+void buddyFree(Arena& arena, long long start, int order) {
+    long long offset = start - arena.begin;
+    arena.freeCellCount += 1LL << order;
+
+    while (order < BUDDY_MAX_ORDER) {
+        long long buddy = offset ^ (1LL << order);
+        set<long long>::iterator it = arena.buddyFreeLists[order].find(buddy);
+        if (it == arena.buddyFreeLists[order].end()) break;  // buddy is (partly) in use
+
+        arena.buddyFreeLists[order].erase(it);
+        arena.freeRunMerges++;
+        if (buddy < offset) offset = buddy;
+        order++;
+    }
+    arena.buddyFreeLists[order].insert(offset);
+}
+
+// Start of the buddy block a (possibly trimmed) super-block lives in
+long long buddyBlockStart(const Arena& arena, const SuperBlock* block) {
+    long long offset = block->startIndex - arena.begin;
+    return arena.begin + (offset & ~((1LL << block->buddyOrder) - 1));
+}
+
+// Gives back cells that were cut off a live super-block by a partial deallocation.
+// In buddy mode they stay reserved until the whole super-block is freed, so they only
+// stop being occupied and count as internal waste.
+void releasePayloadCells(Arena& arena, long long start, long long length) {
+    if (allocatorMode == BUDDY_MODE) {
+        setOccupancy(start, length, false);
+        arena.internalWaste += length;
+    } else {
+        addFreeCells(arena, start, length);
+    }
+}
+
+// Frees a block's cells, unlinks it and deletes it. The caller holds arena.lock and has
+// already taken the block out of the id table.
+void freeSuperBlockLocked(Arena& arena, SuperBlock* block) {
+    // FREE THE MEMORY in memoryPool (clears the occupancy bits, the cells can be reused straight away)
+    if (allocatorMode == BUDDY_MODE) {
+        setOccupancy(block->startIndex, block->sizeOfMemoryBlock, false);
+        arena.internalWaste -= (1LL << block->buddyOrder) - block->sizeOfMemoryBlock;
+        buddyFree(arena, buddyBlockStart(arena, block), block->buddyOrder);
+    } else {
+        addFreeCells(arena, block->startIndex, block->sizeOfMemoryBlock);
+    }
+
+    // Remove from linked list
+    unlinkSuperBlock(arena, block);
+
+    recycleSuperBlock(arena, block);
+}
+
+// Frees everything other threads have queued for this arena. The caller holds arena.lock.
+void drainRemoteFrees(Arena& arena) {
+    vector<SuperBlock*> pending;
+    {
+        lock_guard<mutex> guard(arena.remoteFreeLock);
+        if (arena.remoteFrees.empty()) return;
+        pending.swap(arena.remoteFrees);
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+        freeSuperBlockLocked(arena, pending[i]);
+    }
+}
+
+// Persistent pool (--pool-file): the cells and the occupancy bitmap live in a shared mapping
+// of a file instead of anonymous memory, so the OS writes them back and they outlive the
+// process. The file is laid out as
+//   [header][pool cells][occupancy bitmap][metadata: arenas, then super-blocks, then free runs]
+// with every section starting on a 4 KB boundary and its offset stored in the header.
+// The metadata is written when the pool is released. On the next start the cells and the
+// bitmap are mapped exactly as they are, and the metadata is read back as three plain arrays
+// of fixed-size records - no allocation is replayed and no text is parsed.
+// Resuming is still linear in the number of live blocks: the records have to be turned back
+// into list nodes, the id table and the address / free-run trees (about 250 ms for 700k
+// blocks, mostly the id table and blocksByAddress). Those are pointer-linked structures
+// that can't be used straight from the file, so only the cells and the bitmap are free to resume.
+// cleanShutdown is only set once the metadata is complete, so a crash is noticed on restart.
+// Only the pool of the menu / --script session lives in a file; the benchmarks and the
+// trace replay start from a fresh pool every run and never pass one to initializeMemoryPool.
+string poolFilePath;  // file of the pool that is open now, empty for an anonymous pool
+
+bool poolInFixedStorage = false;  // the pool lives in a MemoryPool's arrays, not in a mapping
+const void* memoryPoolOwner = NULL;  // the MemoryPool type that opened the pool, NULL if none did
+
+struct PoolFileHeader {
+    char magic[8];  // "SBPOOL"
+    uint32_t version;
+    uint32_t cleanShutdown;
+    int64_t poolSize;
+    int64_t poolOffset;
+    int64_t bitmapOffset;
+    int64_t metadataOffset;
+    int32_t arenaCount;
+    int32_t buddyMode;
+    int64_t nextBlockId;
+    int64_t blockCount;
+    int64_t freeRunCount;
+};
+
+struct PersistedArena {
+    int64_t begin, end, freeCellCount, internalWaste, nextFitCursor;
+};
+
+struct PersistedBlock {
+    int64_t startIndex, size;
+    int32_t Blockid, arenaIndex, buddyOrder, originId;
+};
+
+// Extent mode: a free run. Buddy mode: a free block, `start` is its offset in the arena
+// and buddyOrder its order (length is 2^buddyOrder).
+struct PersistedFreeRun {
+    int64_t start, length;
+    int32_t arenaIndex, buddyOrder;
+};
+
+const uint32_t POOL_FILE_VERSION = 1;
+const long long POOL_FILE_PAGE = 4096;
+
+PoolFileHeader* poolFileHeader = NULL;  // start of the file mapping, NULL for an anonymous pool
+long long poolFileMappedBytes = 0;
+#ifdef _WIN32
+HANDLE poolFileHandle = INVALID_HANDLE_VALUE;
+HANDLE poolFileMapping = NULL;
+#endif
+
+long long roundUpToPage(long long bytes) {
+    return (bytes + POOL_FILE_PAGE - 1) / POOL_FILE_PAGE * POOL_FILE_PAGE;
+}
+
+// Maps the first `bytes` of the pool file read/write and shared. With `fresh` the file is
+// emptied first, so the whole mapping starts out as zeroes (and only costs disk space once written).
+void* mapPoolFile(long long bytes, bool fresh) {
+#ifdef _WIN32
+    poolFileHandle = CreateFileA(poolFilePath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                                 OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (poolFileHandle == INVALID_HANDLE_VALUE) return NULL;
+    if (fresh) SetEndOfFile(poolFileHandle);  // the file pointer is at 0, so this empties it
+    // The mapping grows the file to `bytes` if it is shorter
+    poolFileMapping = CreateFileMappingA(poolFileHandle, NULL, PAGE_READWRITE,
+                                         (DWORD)(bytes >> 32), (DWORD)bytes, NULL);
+    void* view = poolFileMapping != NULL ? MapViewOfFile(poolFileMapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)bytes) : NULL;
+    if (view == NULL) {
+        if (poolFileMapping != NULL) CloseHandle(poolFileMapping);
+        CloseHandle(poolFileHandle);
+        poolFileMapping = NULL;
+        poolFileHandle = INVALID_HANDLE_VALUE;
+    }
+    return view;
+#else
+    int fd = open(poolFilePath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return NULL;
+    if ((fresh && ftruncate(fd, 0) != 0) || (lseek(fd, 0, SEEK_END) < bytes && ftruncate(fd, bytes) != 0)) {
+        close(fd);
+        return NULL;
+    }
+    void* mapping = mmap(NULL, (size_t)bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);  // the mapping keeps the file open
+    if (mapping == MAP_FAILED) return NULL;
+    return mapping;
+#endif
+}
+
+// Writes the mapped cells back to the file and unmaps it
+void unmapPoolFile() {
+#ifdef _WIN32
+    FlushViewOfFile(poolFileHeader, 0);
+    UnmapViewOfFile(poolFileHeader);
+    CloseHandle(poolFileMapping);
+    FlushFileBuffers(poolFileHandle);
+    CloseHandle(poolFileHandle);
+    poolFileMapping = NULL;
+    poolFileHandle = INVALID_HANDLE_VALUE;
+#else
+    msync(poolFileHeader, (size_t)poolFileMappedBytes, MS_SYNC);
+    munmap(poolFileHeader, (size_t)poolFileMappedBytes);
+#endif
+    poolFileHeader = NULL;
+    poolFileMappedBytes = 0;
+}
+
+// Where the metadata of a pool of `size` cells starts in the file (pool and bitmap come first)
+long long poolFileMetadataOffset(long long size) {
+    long long bitmapOffset = roundUpToPage(POOL_FILE_PAGE + size);
+    return roundUpToPage(bitmapOffset + (size + 63) / 64 * 8);
+}
+
+// Checks the header of a cleanly closed pool file against the file's size, so the record
+// counts can be trusted to size the vectors they are read into
+bool poolFileHeaderValid(const PoolFileHeader &saved, long long fileSize) {
+    if (saved.poolSize <= 0 || saved.poolSize > fileSize) return false;
+    if (saved.metadataOffset != poolFileMetadataOffset(saved.poolSize)) return false;
+    if (saved.arenaCount < 1 || saved.blockCount < 0 || saved.freeRunCount < 0) return false;
+    if (saved.nextBlockId < 1 || saved.nextBlockId > INT_MAX) return false;
+    long long metadataBytes = fileSize - saved.metadataOffset;
+    if (metadataBytes < 0) return false;
+    if (saved.arenaCount > metadataBytes / (long long)sizeof(PersistedArena)) return false;
+    metadataBytes -= saved.arenaCount * (long long)sizeof(PersistedArena);
+    if (saved.blockCount > metadataBytes / (long long)sizeof(PersistedBlock)) return false;
+    metadataBytes -= saved.blockCount * (long long)sizeof(PersistedBlock);
+    return saved.freeRunCount <= metadataBytes / (long long)sizeof(PersistedFreeRun);
+}
+
+// Checks that every index in the records points at an arena, a buddy order or cells that exist
+bool poolFileRecordsValid(const PoolFileHeader &saved, const vector<PersistedArena> &arenaRecords,
+                          const vector<PersistedBlock> &blockRecords, const vector<PersistedFreeRun> &freeRuns) {
+    for (size_t i = 0; i < arenaRecords.size(); i++) {
+        const PersistedArena &record = arenaRecords[i];
+        if (record.begin < 0 || record.begin >= record.end || record.end > saved.poolSize) return false;
+        if (record.freeCellCount < 0 || record.freeCellCount > record.end - record.begin) return false;
+    }
+    for (size_t i = 0; i < blockRecords.size(); i++) {
+        const PersistedBlock &record = blockRecords[i];
+        if (record.arenaIndex < 0 || record.arenaIndex >= saved.arenaCount || record.Blockid < 1) return false;
+        const PersistedArena &arena = arenaRecords[record.arenaIndex];
+        if (record.size <= 0 || record.startIndex < arena.begin || record.startIndex > arena.end - record.size) return false;
+        if (record.buddyOrder < -1 || record.buddyOrder > BUDDY_MAX_ORDER) return false;
+        if (saved.buddyMode && record.buddyOrder == -1) return false;
+    }
+    for (size_t i = 0; i < freeRuns.size(); i++) {
+        const PersistedFreeRun &run = freeRuns[i];
+        if (run.arenaIndex < 0 || run.arenaIndex >= saved.arenaCount) return false;
+        const PersistedArena &arena = arenaRecords[run.arenaIndex];
+        if (saved.buddyMode) {
+            if (run.buddyOrder < 0 || run.buddyOrder > BUDDY_MAX_ORDER) return false;
+            if (run.start < 0 || run.start > arena.end - arena.begin - (1LL << run.buddyOrder)) return false;
+        } else {
+            if (run.length <= 0 || run.start < arena.begin || run.start > arena.end - run.length) return false;
+        }
+    }
+    return true;
+}
+
+// Maps the pool file. If it holds a cleanly saved pool, that pool is restored (its size, mode
+// and arenas win over the command line) and `resumed` is set; otherwise the file is started
+// over with an empty pool of `size` cells, and the caller sets up the arenas as usual.
+bool openPoolFile(long long &size, bool &resumed) {
+    resumed = false;
+    PoolFileHeader saved = {};
+    vector<PersistedArena> arenaRecords;
+    vector<PersistedBlock> blockRecords;
+    vector<PersistedFreeRun> freeRuns;
+
+    // Read the metadata before mapping (on Windows the mapping locks the file)
+    ifstream existing(poolFilePath, ios::binary | ios::ate);
+    long long fileSize = existing ? (long long)existing.tellg() : 0;
+    existing.seekg(0);
+    if (existing.read((char*)&saved, sizeof(saved)) && memcmp(saved.magic, "SBPOOL", 6) == 0 &&
+        saved.version == POOL_FILE_VERSION) {
+        if (!saved.cleanShutdown) {
+            cout << "Warning: '" << poolFilePath << "' was not closed cleanly, starting with an empty pool" << endl;
+        } else if (!poolFileHeaderValid(saved, fileSize)) {
+            cout << "Warning: '" << poolFilePath << "' is damaged, starting with an empty pool" << endl;
+        } else {
+            arenaRecords.resize((size_t)saved.arenaCount);
+            blockRecords.resize((size_t)saved.blockCount);
+            freeRuns.resize((size_t)saved.freeRunCount);
+            existing.seekg(saved.metadataOffset);
+            existing.read((char*)arenaRecords.data(), arenaRecords.size() * sizeof(PersistedArena));
+            existing.read((char*)blockRecords.data(), blockRecords.size() * sizeof(PersistedBlock));
+            existing.read((char*)freeRuns.data(), freeRuns.size() * sizeof(PersistedFreeRun));
+            if (!existing) {
+                cout << "Warning: '" << poolFilePath << "' is truncated, starting with an empty pool" << endl;
+            } else if (!poolFileRecordsValid(saved, arenaRecords, blockRecords, freeRuns)) {
+                cout << "Warning: '" << poolFilePath << "' is damaged, starting with an empty pool" << endl;
+            } else {
+                resumed = true;
             }
-            currentLength++;  // Increase the length of current sequence
-            
-            // Check if we've found a large enough block
-            if (currentLength >= size) {
-                return currentStart;  // Return the start of this sequence
+        }
+    }
+    existing.close();
+
+    if (resumed) size = saved.poolSize;
+    long long words = (size + 63) / 64;
+    PoolFileHeader header = {};
+    memcpy(header.magic, "SBPOOL", 6);
+    header.version = POOL_FILE_VERSION;
+    header.poolSize = size;
+    header.poolOffset = POOL_FILE_PAGE;
+    header.bitmapOffset = roundUpToPage(header.poolOffset + size);
+    header.metadataOffset = poolFileMetadataOffset(size);
+
+    void* mapping = mapPoolFile(header.metadataOffset, !resumed);
+    if (mapping == NULL) {
+        cout << "Error: Could not map pool file '" << poolFilePath << "'" << endl;
+        return false;
+    }
+    poolFileHeader = (PoolFileHeader*)mapping;
+    poolFileMappedBytes = header.metadataOffset;
+    memoryPool = (char*)mapping + header.poolOffset;
+    occupancyBitmap = (uint64_t*)((char*)mapping + header.bitmapOffset);
+    poolSize = size;
+    bitmapWordCount = words;
+
+    if (!resumed) {
+        header.buddyMode = allocatorMode == BUDDY_MODE;
+        *poolFileHeader = header;
+        return true;
+    }
+
+    // The pool is in use now: until it is saved again, the file doesn't describe it
+    poolFileHeader->cleanShutdown = 0;
+    allocatorMode = saved.buddyMode ? BUDDY_MODE : EXTENT_MODE;
+    for (size_t i = 0; i < arenaRecords.size(); i++) {
+        const PersistedArena &record = arenaRecords[i];
+        Arena* arena = new Arena((int)i, record.begin, record.end);
+        arena->freeCellCount = record.freeCellCount;
+        arena->internalWaste = record.internalWaste;
+        arena->nextFitCursor = record.nextFitCursor;
+        if (allocatorMode == BUDDY_MODE) arena->buddyFreeLists.assign(BUDDY_MAX_ORDER + 1, set<long long>());
+        arenas.push_back(arena);
+    }
+    // The indexes are rebuilt from sorted input, appending at the end of each tree (O(1) per
+    // entry instead of a search). Free runs were saved in address order.
+    vector<vector<pair<long long, long long>>> runsBySize(arenas.size());
+    for (size_t i = 0; i < freeRuns.size(); i++) {
+        const PersistedFreeRun &run = freeRuns[i];
+        Arena& arena = *arenas[run.arenaIndex];
+        if (allocatorMode == BUDDY_MODE) {
+            arena.buddyFreeLists[run.buddyOrder].insert(arena.buddyFreeLists[run.buddyOrder].end(), run.start);
+        } else {
+            arena.freeExtentsByStart.emplace_hint(arena.freeExtentsByStart.end(), run.start, run.length);
+            runsBySize[run.arenaIndex].push_back(make_pair(run.length, run.start));
+        }
+    }
+    for (size_t a = 0; a < arenas.size(); a++) {
+        sort(runsBySize[a].begin(), runsBySize[a].end());
+        for (size_t i = 0; i < runsBySize[a].size(); i++) {
+            arenas[a]->freeExtentsBySize.insert(arenas[a]->freeExtentsBySize.end(), runsBySize[a][i]);
+        }
+    }
+
+    // Records are in list order, so appending them rebuilds each arena's list as it was.
+    // Nobody else can see the pool yet, so the id table is filled without taking the shard locks.
+    for (int i = 0; i < BLOCK_TABLE_SHARDS; i++) {
+        blockTable[i].blocks.reserve(blockRecords.size() / BLOCK_TABLE_SHARDS + 1);
+    }
+    vector<vector<pair<long long, SuperBlock*>>> byAddress(arenas.size());
+    for (size_t i = 0; i < blockRecords.size(); i++) {
+        const PersistedBlock &record = blockRecords[i];
+        Arena& arena = *arenas[record.arenaIndex];
+        SuperBlock* block = newSuperBlock(arena, record.startIndex, record.size);
+        block->Blockid = record.Blockid;
+        block->arenaIndex = record.arenaIndex;
+        block->buddyOrder = record.buddyOrder;
+        block->originId = record.originId;
+        block->prev = arena.tail;
+        if (arena.tail != NULL) arena.tail->next = block;
+        else arena.head = block;
+        arena.tail = block;
+        arena.liveBlocks++;
+        blockTableShard(block->Blockid).blocks.emplace(block->Blockid, block);
+        byAddress[record.arenaIndex].push_back(make_pair(block->startIndex, block));
+    }
+    for (size_t a = 0; a < arenas.size(); a++) {
+        sort(byAddress[a].begin(), byAddress[a].end());
+        for (size_t i = 0; i < byAddress[a].size(); i++) {
+            arenas[a]->blocksByAddress.emplace_hint(arenas[a]->blocksByAddress.end(), byAddress[a][i]);
+        }
+    }
+
+    // Carry on numbering after the saved ids
+    nextBlockId = (int)saved.nextBlockId;
+    threadNextBlockId = 0;
+    threadLastBlockId = -1;
+    return true;
+}
+
+// Writes the arenas, super-blocks and free runs behind the pool and bitmap, then marks
+// the file as cleanly closed. Unmaps the file.
+void savePoolFile() {
+    vector<PersistedArena> arenaRecords;
+    vector<PersistedBlock> blockRecords;
+    vector<PersistedFreeRun> freeRuns;
+    for (size_t i = 0; i < arenas.size(); i++) {
+        Arena& arena = *arenas[i];
+        lock_guard<mutex> guard(arena.lock);
+        drainRemoteFrees(arena);
+
+        PersistedArena record = {arena.begin, arena.end, arena.freeCellCount, arena.internalWaste, arena.nextFitCursor};
+        arenaRecords.push_back(record);
+        for (SuperBlock* block = arena.head; block != NULL; block = block->next) {
+            PersistedBlock saved = {block->startIndex, block->sizeOfMemoryBlock, block->Blockid,
+                                    block->arenaIndex, block->buddyOrder, block->originId};
+            blockRecords.push_back(saved);
+        }
+        if (allocatorMode == BUDDY_MODE) {
+            for (int order = 0; order <= BUDDY_MAX_ORDER; order++) {
+                for (set<long long>::iterator it = arena.buddyFreeLists[order].begin(); it != arena.buddyFreeLists[order].end(); it++) {
+                    PersistedFreeRun run = {*it, 1LL << order, (int32_t)i, order};
+                    freeRuns.push_back(run);
+                }
             }
         } else {
-            // Hit an occupied block - reset our search
-            currentStart = -1;
-            currentLength = 0;
+            for (map<long long, long long>::iterator it = arena.freeExtentsByStart.begin(); it != arena.freeExtentsByStart.end(); it++) {
+                PersistedFreeRun run = {it->first, it->second, (int32_t)i, -1};
+                freeRuns.push_back(run);
+            }
         }
     }
-    
-    // If we finish the loop without finding a block
-    return -1;
+
+    PoolFileHeader header = *poolFileHeader;
+    header.cleanShutdown = 0;
+    header.arenaCount = (int32_t)arenaRecords.size();
+    header.blockCount = (int64_t)blockRecords.size();
+    header.freeRunCount = (int64_t)freeRuns.size();
+    // If this thread took the latest id batch, nothing above its next id was handed out
+    header.nextBlockId = threadLastBlockId + 1 == nextBlockId ? threadNextBlockId : nextBlockId.load();
+    unmapPoolFile();
+
+    fstream file(poolFilePath, ios::in | ios::out | ios::binary);
+    file.seekp(header.metadataOffset);
+    file.write((const char*)arenaRecords.data(), arenaRecords.size() * sizeof(PersistedArena));
+    file.write((const char*)blockRecords.data(), blockRecords.size() * sizeof(PersistedBlock));
+    file.write((const char*)freeRuns.data(), freeRuns.size() * sizeof(PersistedFreeRun));
+    file.flush();
+    if (!file) {
+        cout << "Error: Could not save the pool metadata to '" << poolFilePath << "'" << endl;
+        return;
+    }
+    header.cleanShutdown = 1;
+    file.seekp(0);
+    file.write((const char*)&header, sizeof(header));
 }
 
-SuperBlock* Append(int startIndex, int size) {
-    if (tail != 0) { // if the linked list is NOT empty;
-        tail->next = new SuperBlock(startIndex, size);
-        tail = tail->next;
+// Gives the mappings back to the OS and deletes every super-block
+// (the nodes live in the arenas' slabs, so deleting the arenas takes care of them).
+// A file-backed pool is saved first.
+void releaseMemoryPool() {
+    if (memoryPool == NULL) return;
+
+    if (poolFileHeader != NULL) {
+        savePoolFile();
+    } else if (!poolInFixedStorage) {
+        releaseZeroedMemory(memoryPool, poolSize);
+        releaseZeroedMemory(occupancyBitmap, bitmapWordCount * 8);
+    } else {
+        // Fixed storage is reused by the next pool, which expects it to be all zeroes
+        clearWrittenPages(memoryPool, poolSize);
+        clearWrittenPages((char*)occupancyBitmap, bitmapWordCount * 8);
     }
-    else head = tail = new SuperBlock(startIndex, size);
+    poolInFixedStorage = false;
+    memoryPoolOwner = NULL;
+    poolFilePath.clear();
 
-    tail->Blockid = nextBlockId;  // Set the Blockid
+    for (size_t i = 0; i < arenas.size(); i++) {
+        delete arenas[i];
+    }
+    arenas.clear();
+    for (int i = 0; i < BLOCK_TABLE_SHARDS; i++) {
+        blockTable[i].blocks.clear();
+    }
 
-     // INCREMENT for the next block that will be created
-    nextBlockId++;
+    memoryPool = NULL;
+    occupancyBitmap = NULL;
+    poolSize = 0;
+    bitmapWordCount = 0;
+}
 
-    return tail;
+// Reserves `size` cells for the pool (see reserveZeroedMemory), plus the occupancy bitmap,
+// and cuts the pool into `arenaCount` arenas (fewer if the pool is too small for that many).
+// With a pool file (filePath), the pool saved in it is resumed instead (see openPoolFile).
+// fixedCells / fixedBitmap: storage the caller owns (see MemoryPool) to use instead of a mapping.
+bool initializeMemoryPool(long long size, int arenaCount, const string &filePath = string(),
+                          char* fixedCells = NULL, uint64_t* fixedBitmap = NULL) {
+        if (size <= 0) {
+            cout << "Error: Pool size must be positive" << endl;
+            return false;
+        }
 
+        poolFilePath = fixedCells == NULL ? filePath : string();
+        if (!poolFilePath.empty()) {
+            bool resumed;
+            chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+            if (!openPoolFile(size, resumed)) return false;
+            if (resumed) {
+                long long blocks = 0;
+                for (size_t i = 0; i < arenas.size(); i++) blocks += arenas[i]->liveBlocks;
+                cout << "Resumed " << blocks << " super-block(s) in " << poolSize << " cells from '" << poolFilePath
+                     << "' in " << chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count() << " ms" << endl;
+                return true;
+            }
+            // A new pool file is all zeroes, just like a fresh anonymous mapping - set it up below
+        }
 
+        long long words = (size + 63) / 64;
+        if (fixedCells != NULL) {
+            // Zero-filled like a fresh mapping: it starts out that way and releaseMemoryPool
+            // clears whatever an earlier pool wrote
+            memoryPool = fixedCells;
+            occupancyBitmap = fixedBitmap;
+            poolInFixedStorage = true;
+        } else if (poolFileHeader == NULL) {
+            memoryPool = (char*)reserveZeroedMemory(size);
+            occupancyBitmap = (uint64_t*)reserveZeroedMemory(words * 8);
+        }
+        if (memoryPool == NULL || occupancyBitmap == NULL) {
+            cout << "Error: Could not reserve " << size << " cells for the memory pool" << endl;
+            releaseZeroedMemory(memoryPool, size);
+            releaseZeroedMemory(occupancyBitmap, words * 8);
+            memoryPool = NULL;
+            occupancyBitmap = NULL;
+            return false;
+        }
+        poolSize = size;
+        bitmapWordCount = words;
+
+        // Each building block represents one character.
+        // At the beginning, all blocks are empty. A fresh mapping is already all zeroes, so
+        // every bit says "free" and we don't have to touch any page here...
+        // ...except the padding bits past the end of the pool, which count as occupied.
+        if (size % 64 != 0) {
+            occupancyBitmap[words - 1] = ~0ULL << (size % 64);
+        }
+
+        // Arena sizes are rounded down to whole bitmap words; the last arena takes the rest
+        if (arenaCount < 1) arenaCount = 1;
+        long long cellsPerArena = (size / arenaCount) / 64 * 64;
+        if (cellsPerArena == 0) {
+            arenaCount = 1;
+        }
+        for (int i = 0; i < arenaCount; i++) {
+            long long first = i * cellsPerArena;
+            long long last = (i == arenaCount - 1) ? size : first + cellsPerArena;
+            Arena* arena = new Arena(i, first, last);
+
+            // ...and the whole arena is one single free run (or a few buddy blocks). Its bits
+            // are already 0, so only the index and the count change (addFreeCells would write
+            // every bitmap word).
+            if (allocatorMode == BUDDY_MODE) {
+                initializeBuddyArena(*arena);
+            } else {
+                addFreeExtent(*arena, first, last - first);
+                arena->freeCellCount += last - first;
+            }
+            arenas.push_back(arena);
+        }
+        return true;
+    }
+
+// Where new strings are placed
+enum PlacementPolicy {
+    BEST_FIT,       // smallest free run that fits (free-extent index)
+    FIRST_FIT,      // lowest free run that fits (bitmap search), like the original cell-by-cell scan
+    NEXT_FIT,       // first fit, but starting where the previous search stopped and wrapping around
+    WORST_FIT,      // largest free run, so the leftover piece is as big as possible
+    SEGREGATED_FIT  // a run from the smallest power-of-two size class that always fits
+};
+const char* placementPolicyNames[] = {"best-fit", "first-fit", "next-fit", "worst-fit", "segregated-fit"};
+PlacementPolicy placementPolicy = BEST_FIT;
+
+// The policies themselves: each has a static find() that returns the start of a free run in
+// the arena that can hold `size` cells, or -1. The caller holds arena.lock.
+// They are template arguments of the allocation functions, so the search is inlined into them.
+// The PlacementPolicy setting only picks one of those instantiations, once per call.
+
+// Best fit: instead of scanning every cell, we ask the size-ordered index for the first run
+// whose length is >= size, which takes O(log n) in the number of free runs.
+struct BestFitPolicy {
+    static long long find(Arena& arena, long long size) {
+        set<pair<long long, long long>>::iterator it = arena.freeExtentsBySize.lower_bound(make_pair(size, -1));
+
+        // If no run is long enough
+        if (it == arena.freeExtentsBySize.end()) {
+            return -1;
+        }
+        return it->second;  // Return the start of this run
+    }
+};
+
+// First fit: the bitmap is searched from the start of the arena, 64 cells at a time.
+struct FirstFitPolicy {
+    static long long find(Arena& arena, long long size) {
+        return findFreeRunInBitmap(size, arena.begin, arena.end);
+    }
+};
+
+// Next fit: the same bitmap search, starting at the cursor and wrapping to the arena start.
+struct NextFitPolicy {
+    static long long find(Arena& arena, long long size) {
+        long long start = -1;
+        if (arena.nextFitCursor < arena.end) start = findFreeRunInBitmap(size, arena.nextFitCursor, arena.end);
+        if (start == -1) start = findFreeRunInBitmap(size, arena.begin, arena.end);
+        if (start != -1) arena.nextFitCursor = start + size;
+        return start;
+    }
+};
+
+// Worst fit: the last entry of the size-ordered index.
+struct WorstFitPolicy {
+    static long long find(Arena& arena, long long size) {
+        if (arena.freeExtentsBySize.empty()) return -1;
+        const pair<long long, long long> &largest = *arena.freeExtentsBySize.rbegin();
+        return largest.first >= size ? largest.second : -1;
+    }
+};
+
+// Segregated fit: free runs fall into size classes [2^k, 2^(k+1)). A request is served from
+// the smallest class that is at least as big as the request rounded up to a power of two,
+// where every run fits without looking at its length; only if there is none does it look for
+// a run in the request's own class. The classes are just ranges of the size-ordered index,
+// so there are no extra lists to keep up to date.
+struct SegregatedFitPolicy {
+    static long long find(Arena& arena, long long size) {
+        int sizeClass = buddyOrderFor(size);  // smallest k with 2^k >= size
+        set<pair<long long, long long>>::iterator it = arena.freeExtentsBySize.lower_bound(make_pair(1LL << sizeClass, -1));
+        if (it == arena.freeExtentsBySize.end()) it = arena.freeExtentsBySize.lower_bound(make_pair(size, -1));
+        if (it == arena.freeExtentsBySize.end()) return -1;
+        return it->second;
+    }
+};
+
+// Calls action(policy) with an object of the policy type that placementPolicy selects
+template <typename Action>
+auto withPlacementPolicy(Action action) {
+    switch (placementPolicy) {
+        case FIRST_FIT: return action(FirstFitPolicy());
+        case NEXT_FIT: return action(NextFitPolicy());
+        case WORST_FIT: return action(WorstFitPolicy());
+        case SEGREGATED_FIT: return action(SegregatedFitPolicy());
+        default: return action(BestFitPolicy());
+    }
+}
+
+// Finds a free run in the arena that can hold `size` cells with the current placement policy.
+// The caller holds arena.lock.
+long long findAvailableBlock(Arena& arena, long long size) {
+    return withPlacementPolicy([&](auto policy) { return decltype(policy)::find(arena, size); });
+}
+
+SuperBlock* Append(Arena& arena, long long startIndex, long long size) {
+    SuperBlock* block = newSuperBlock(arena, startIndex, size);
+    if (arena.tail != 0) { // if the linked list is NOT empty;
+        arena.tail->next = block;
+        block->prev = arena.tail;
+        arena.tail = block;
+    }
+    else arena.head = arena.tail = block;
+
+    block->Blockid = takeNextBlockId();  // Set the Blockid
+    block->originId = block->Blockid;
+    block->arenaIndex = arena.index;
+    registerSuperBlock(arena, block);
+
+    return block;
+}
+
+// What one compaction call did
+struct CompactionReport {
+    long long bytesMoved;
+    int blocksMoved;
+    int blocksMerged;  // parts of split super-blocks that ended up side by side and were joined
+    double milliseconds;
+    bool finished;  // true when all live blocks are packed at the start of their arena
+    vector<pair<int, int>> mergedIds;  // (retired id, id of the part it was joined into)
+};
+
+// compactMemoryPool joins the parts of a split super-block that it brings back together.
+// runTrace turns this off and joins only the parts the recorded run joined, so its ids keep matching.
+bool compactionMergesParts = true;
+
+// Joins `later` (which must start right where `earlier` ends) into `earlier` and retires
+// later's id. A block whose id is already out of the table is being freed by someone else
+// (or waits in remoteFrees), so it is left alone; returns whether the two were joined.
+// The caller holds arena.lock.
+bool mergeSuperBlockIntoLocked(Arena& arena, SuperBlock* earlier, SuperBlock* later) {
+    if (takeSuperBlock(later->Blockid) != later) {
+        return false;
+    }
+    recordTraceEvent(TRACE_MERGE, later->Blockid, earlier->Blockid, 0, 0);
+    earlier->sizeOfMemoryBlock += later->sizeOfMemoryBlock;
+    unlinkSuperBlock(arena, later);
+    recycleSuperBlock(arena, later);
+    arena.superBlockMerges++;
+    return true;
 }
 
+// Compaction: slides live blocks towards the start of the arena so that all free cells end up in one run.
+// It always works on the lowest free run: the block right after it is moved down into it,
+// and the free run moves up behind the block (and merges with the next free run).
+// With byteBudget > 0 it stops once moving the next block would take report.bytesMoved over
+// the budget, so the work can be spread over many calls; byteBudget <= 0 compacts everything.
+// Moving blocks down also brings the parts of a split super-block back together. With
+// mergeParts, a part that lands right behind an earlier part of the same string is joined
+// into it, so splits don't leave behind more and more list nodes. The later id is retired
+// and listed in report.mergedIds, so only a compaction the caller asked for merges (the
+// automatic one in allocateInArena doesn't: nobody there could be told about the new ids).
+// Pinned blocks stay where they are; the free run in front of one is skipped and compaction
+// carries on behind it.
+// The caller holds arena.lock. Buddy blocks must stay aligned to their size, so in
+// BUDDY_MODE nothing is moved.
+void compactArena(Arena& arena, long long byteBudget, CompactionReport &report, bool mergeParts) {
+    if (allocatorMode == BUDDY_MODE) return;
+
+    long long scanFrom = arena.begin;  // free runs before this are stuck in front of pinned blocks
+    while (true) {
+        map<long long, long long>::iterator run = arena.freeExtentsByStart.lower_bound(scanFrom);
+        if (run == arena.freeExtentsByStart.end()) {
+            break;  // no free run left to compact
+        }
+        long long freeStart = run->first;
+        long long freeLength = run->second;
+
+        // Free runs are always merged, so the cell after one is either a block or the end of the arena
+        map<long long, SuperBlock*>::iterator next = arena.blocksByAddress.find(freeStart + freeLength);
+        if (next == arena.blocksByAddress.end()) {
+            break;
+        }
+        SuperBlock* block = next->second;
+        long long size = block->sizeOfMemoryBlock;
+        if (block->pinned) {
+            scanFrom = block->startIndex + size;
+            continue;
+        }
+
+        // Always move at least one block per call so progress is guaranteed
+        if (byteBudget > 0 && report.bytesMoved > 0 && report.bytesMoved + size > byteBudget) {
+            report.finished = false;
+            return;
+        }
+
+        // Move the payload down (the ranges may overlap, so memmove)
+        memmove(memoryPool + freeStart, memoryPool + block->startIndex, size);
+
+        // The free run now sits right after the moved block
+        arena.freeExtentsBySize.erase(make_pair(freeLength, freeStart));
+        arena.freeExtentsByStart.erase(freeStart);
+        addFreeExtent(arena, freeStart + size, freeLength);
+        setOccupancy(freeStart, size, true);
+        setOccupancy(freeStart + size, freeLength, false);
+        setSuperBlockStart(arena, block, freeStart);
+
+        report.bytesMoved += size;
+        report.blocksMoved++;
+
+        map<long long, SuperBlock*>::iterator moved = arena.blocksByAddress.find(freeStart);
+        if (mergeParts && moved != arena.blocksByAddress.begin()) {
+            SuperBlock* before = prev(moved)->second;
+            int retiredId = block->Blockid;
+            if (before->originId == block->originId && before->startIndex + before->sizeOfMemoryBlock == freeStart &&
+                mergeSuperBlockIntoLocked(arena, before, block)) {
+                report.blocksMerged++;
+                report.mergedIds.push_back(make_pair(retiredId, before->Blockid));
+            }
+        }
+    }
+}
+
+// Compacts every arena in turn, sharing one byte budget between them. Split parts that end
+// up side by side are merged; the report says which ids were retired and where they went.
+CompactionReport compactMemoryPool(long long byteBudget) {
+    LatencyTimer timer(OP_COMPACT);
+    CompactionReport report = {0, 0, 0, 0.0, true};
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    recordTraceEvent(TRACE_COMPACT, 0, 0, -1, byteBudget);
+
+    for (size_t i = 0; i < arenas.size() && report.finished; i++) {
+        lock_guard<mutex> guard(arenas[i]->lock);
+        drainRemoteFrees(*arenas[i]);
+        compactArena(*arenas[i], byteBudget, report, compactionMergesParts);
+    }
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    report.milliseconds = chrono::duration<double, milli>(end - begin).count();
+    return report;
+}
+
+void displayCompactionReport(const CompactionReport &report) {
+    cout << "Compaction moved " << report.blocksMoved << " super-block(s), "
+         << report.bytesMoved << " bytes in " << report.milliseconds << " ms";
+    if (report.blocksMerged > 0) cout << ", re-merged " << report.blocksMerged << " split part(s)";
+    if (report.finished) cout << " (pool fully compacted)";
+    cout << endl;
+    for (size_t i = 0; i < report.mergedIds.size(); i++) {
+        cout << "  Super-block " << report.mergedIds[i].first << " is now part of super-block "
+             << report.mergedIds[i].second << endl;
+    }
+}
+
+// Reserves `counter` cells in a free spot of the arena, starting at an address that is a
+// multiple of `alignment` (a power of two), copies `data` into them unless it is NULL and
+// creates their SuperBlock. Returns nullptr if nothing fits. The caller holds arena.lock.
+template <typename Policy>
+SuperBlock* placeCellsLocked(Arena& arena, long long counter, long long alignment, const char* data, bool pinned) {
+    SuperBlock* newBlock;
+    if (allocatorMode == BUDDY_MODE) {
+        // Step 2 + 3: take a power-of-two block. Blocks are aligned to their size (as far as
+        // the arena's own start is), so one at least `alignment` cells big is aligned too.
+        int order = buddyOrderFor(max(counter, alignment));
+        long long blockStart = buddyAllocate(arena, order);
+        if (blockStart == -1) return nullptr;
+        if ((uintptr_t)(memoryPool + blockStart) % alignment != 0) {
+            buddyFree(arena, blockStart, order);  // more alignment than the arena has
+            return nullptr;
+        }
+        setOccupancy(blockStart, counter, true);
+        arena.internalWaste += (1LL << order) - counter;
+
+        // Step 4: Create SuperBlock to track this allocation
+        newBlock = Append(arena, blockStart, counter);
+        newBlock->buddyOrder = order;
+    } else {
+        // Step 2: Find available space using the placement policy, with room to move the
+        // start up to the next aligned address
+        long long runStart = Policy::find(arena, counter + alignment - 1);
+        if (runStart == -1) {
+            return nullptr;
+        }
+        long long startIndex = runStart + (alignment - (long long)((uintptr_t)(memoryPool + runStart) % alignment)) % alignment;
+
+        // Step 3: "Allocate" the cells, Step 4: Create SuperBlock to track this allocation
+        removeFreeRange(arena, startIndex, counter);
+        newBlock = Append(arena, startIndex, counter);
+    }
+
+    if (data != NULL) memcpy(memoryPool + newBlock->startIndex, data, (size_t)counter);
+    newBlock->pinned = pinned;
+    return newBlock;
+}
+
+// Writes `str` into a free spot of the arena and creates its SuperBlock, or returns nullptr
+// if nothing fits. The caller holds arena.lock.
+template <typename Policy>
+SuperBlock* placeStringLocked(Arena& arena, const std::string &str, long long counter) {
+    return placeCellsLocked<Policy>(arena, counter, 1, str.data(), false);
+}
+
+// Same, with the current placement policy
+SuperBlock* placeStringLocked(Arena& arena, const std::string &str, long long counter) {
+    return withPlacementPolicy([&](auto policy) { return placeStringLocked<decltype(policy)>(arena, str, counter); });
+}
+
+// Tries to place the cells in one arena. With compactIfNeeded, an arena that has enough free
+// cells in total (just not in one run) is compacted first.
+template <typename Policy>
+SuperBlock* allocateInArena(Arena& arena, long long counter, long long alignment, const char* data, bool pinned,
+                            bool compactIfNeeded) {
+    lock_guard<mutex> guard(arena.lock);
+    drainRemoteFrees(arena);
+
+    SuperBlock* newBlock = placeCellsLocked<Policy>(arena, counter, alignment, data, pinned);
+    if (newBlock == nullptr && compactIfNeeded && allocatorMode == EXTENT_MODE && arena.freeCellCount >= counter) {
+        // Enough free cells in total, they are just scattered - pack them together and retry
+        CompactionReport report = {0, 0, 0, 0.0, true};
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        recordTraceEvent(TRACE_COMPACT, 0, 0, arena.index, 0);
+        compactArena(arena, 0, report, false);
+        report.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+        if (verboseOutput) displayCompactionReport(report);
+        newBlock = placeCellsLocked<Policy>(arena, counter, alignment, data, pinned);
+    }
+    return newBlock;
+}
+
+// Allocates a super-block of `counter` cells (see placeCellsLocked for the other arguments).
+// First try the calling thread's own arena, then fall back to the others,
+// and only compact when no arena has a free run that is long enough
+template <typename Policy>
+SuperBlock* allocateCells(long long counter, long long alignment, const char* data, bool pinned) {
+    LatencyTimer timer(OP_ALLOCATE);
+    int home = homeArenaIndex();
+    int count = (int)arenas.size();
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < count; i++) {
+            Arena& arena = *arenas[(home + i) % count];
+            SuperBlock* newBlock = allocateInArena<Policy>(arena, counter, alignment, data, pinned, pass == 1);
+            if (newBlock != nullptr) {
+                recordTraceEvent(TRACE_ALLOCATE, newBlock->Blockid, 0, 0, counter);
+                return newBlock;
+            }
+        }
+    }
+
+    if (verboseOutput) cout << "Error: Not enough contiguous memory!" << endl;
+    return nullptr;
+}
+
+template <typename Policy>
 SuperBlock* allocateSuperBlockForString(const std::string &str) {
      // Step 1: Calculate how many blocks needed
-    int counter = 0;
-    for (int i = 0; i < str.size(); i++) {
+    long long counter = 0;
+    for (size_t i = 0; i < str.size(); i++) {
         counter++;
     }
-
-    // Step 2: Find available space using findAvailableBlock()
-    int startIndex = findAvailableBlock(counter);
-    if (startIndex == -1) {
-        cout << "Error: Not enough contiguous memory!" << endl;
+    if (counter == 0) {
+        if (verboseOutput) cout << "Error: Cannot allocate an empty string!" << endl;
         return nullptr;
     }
+    return allocateCells<Policy>(counter, 1, str.data(), false);
+}
+
+// Same, with the current placement policy
+SuperBlock* allocateSuperBlockForString(const std::string &str) {
+    return withPlacementPolicy([&](auto policy) { return allocateSuperBlockForString<decltype(policy)>(str); });
+}
+
+// Batch allocation: places a whole vector of strings with one lock and one placement pass.
+// In extent mode the batch first asks for a single free run big enough for all of them,
+// carves it out once and writes the strings back to back. If there is no such run, each
+// string is placed separately - still under the same lock. Anything that didn't fit in the
+// home arena goes through allocateSuperBlockForString (other arenas, compaction).
+// The result has one entry per string, nullptr where the allocation failed.
+template <typename Policy>
+vector<SuperBlock*> allocateSuperBlocksForStrings(const vector<string> &strs) {
+    LatencyTimer timer(OP_BATCH_ALLOCATE);
+    vector<SuperBlock*> blocks(strs.size(), nullptr);
+    long long totalSize = 0;
+    for (size_t i = 0; i < strs.size(); i++) {
+        totalSize += (long long)strs[i].size();
+    }
 
-     // Step 3: "Allocate" by writing string into memoryPool
-     for (int i = 0; i < counter; i++) {
-        memoryPool[startIndex + i] = str[i];
-     }
+    Arena& arena = *arenas[homeArenaIndex()];
+    {
+        lock_guard<mutex> guard(arena.lock);
+        drainRemoteFrees(arena);
 
-      // Step 4: Create SuperBlock to track this allocation
-      SuperBlock* newBlock = Append(startIndex, counter);
-      newBlock->data = str;
+        long long startIndex = -1;
+        if (allocatorMode == EXTENT_MODE && totalSize > 0) {
+            startIndex = Policy::find(arena, totalSize);
+        }
 
-      return newBlock;
+        if (startIndex != -1) {
+            // One run for the whole batch: a single carve, then consecutive writes
+            removeFreeRange(arena, startIndex, totalSize);
+            long long position = startIndex;
+            for (size_t i = 0; i < strs.size(); i++) {
+                long long counter = (long long)strs[i].size();
+                if (counter == 0) continue;
+                memcpy(memoryPool + position, strs[i].data(), (size_t)counter);
+                blocks[i] = Append(arena, position, counter);
+                position += counter;
+            }
+        } else {
+            for (size_t i = 0; i < strs.size(); i++) {
+                if (strs[i].empty()) continue;
+                blocks[i] = placeStringLocked<Policy>(arena, strs[i], (long long)strs[i].size());
+            }
+        }
+    }
+
+    for (size_t i = 0; i < strs.size(); i++) {
+        if (blocks[i] != nullptr) recordTraceEvent(TRACE_ALLOCATE, blocks[i]->Blockid, 0, 0, (long long)strs[i].size());
+    }
+
+    // Whatever didn't fit at home takes the normal path
+    int allocated = 0;
+    for (size_t i = 0; i < strs.size(); i++) {
+        if (blocks[i] == nullptr && !strs[i].empty()) {
+            blocks[i] = allocateSuperBlockForString<Policy>(strs[i]);
+        }
+        if (blocks[i] != nullptr) allocated++;
+    }
+
+    if (verboseOutput) cout << "Batch allocated " << allocated << " of " << strs.size() << " strings" << endl;
+    return blocks;
+}
+
+// Same, with the current placement policy
+vector<SuperBlock*> allocateSuperBlocksForStrings(const vector<string> &strs) {
+    return withPlacementPolicy([&](auto policy) { return allocateSuperBlocksForStrings<decltype(policy)>(strs); });
+}
+
+// Allocator statistics, cheap enough to poll while the allocator is in use: every number
+// is a counter the allocator keeps up to date anyway, so reading them is one short lock
+// per arena plus adding up the latency histograms.
+// Internal fragmentation: cells that are reserved for a super-block but hold no payload
+// (only buddy mode has these - the rounding up to a power of two, plus trimmed cells).
+// External fragmentation: free cells that are useless for a big request because they are
+// not part of the largest free block, as a fraction of all free cells.
+struct AllocatorStats {
+    long long liveBytes;
+    long long liveBlocks;
+    long long freeCells;
+    long long largestFreeBlock;
+    long long internalWaste;
+    double internalFragmentation;  // internalWaste / reserved cells
+    double externalFragmentation;  // 1 - largestFreeBlock / freeCells
+    long long freeRunSplits;
+    long long freeRunMerges;
+    long long superBlockSplits;
+    long long superBlockMerges;
+    unsigned long long latency[OPERATION_KINDS][LATENCY_BUCKETS];
+};
+
+// Longest free run (or biggest free buddy block) in the arena. The caller holds arena.lock.
+long long largestFreeBlockLocked(const Arena& arena) {
+    if (allocatorMode == BUDDY_MODE) {
+        for (int order = BUDDY_MAX_ORDER; order >= 0; order--) {
+            if (!arena.buddyFreeLists[order].empty()) return 1LL << order;
+        }
+        return 0;
+    }
+    if (arena.freeExtentsBySize.empty()) return 0;
+    return arena.freeExtentsBySize.rbegin()->first;
 }
 
-// Function to display the entire memory pool;
-// This shows what's actually stored in each of the 64 memory blocks:
+AllocatorStats getAllocatorStats() {
+    AllocatorStats stats = {};
+    for (size_t i = 0; i < arenas.size(); i++) {
+        Arena& arena = *arenas[i];
+        lock_guard<mutex> guard(arena.lock);
+        drainRemoteFrees(arena);
+
+        long long largest = largestFreeBlockLocked(arena);
+        stats.freeCells += arena.freeCellCount;
+        stats.internalWaste += arena.internalWaste;
+        stats.liveBytes += (arena.end - arena.begin) - arena.freeCellCount - arena.internalWaste;
+        stats.liveBlocks += arena.liveBlocks;
+        stats.freeRunSplits += arena.freeRunSplits;
+        stats.freeRunMerges += arena.freeRunMerges;
+        stats.superBlockSplits += arena.superBlockSplits;
+        stats.superBlockMerges += arena.superBlockMerges;
+        if (largest > stats.largestFreeBlock) stats.largestFreeBlock = largest;
+    }
+
+    long long reservedCells = poolSize - stats.freeCells;
+    if (reservedCells > 0) stats.internalFragmentation = (double)stats.internalWaste / reservedCells;
+    if (stats.freeCells > 0) stats.externalFragmentation = 1.0 - (double)stats.largestFreeBlock / stats.freeCells;
+
+    lock_guard<mutex> guard(histogramRegistryLock);
+    for (size_t t = 0; t < histogramRegistry.size(); t++) {
+        for (int k = 0; k < OPERATION_KINDS; k++)
+            for (int b = 0; b < LATENCY_BUCKETS; b++)
+                stats.latency[k][b] += histogramRegistry[t]->counts[k][b].load(memory_order_relaxed);
+    }
+    return stats;
+}
+
+// Upper edge (in ns) of the histogram bucket that holds the given fraction of the calls
+long long latencyPercentile(const unsigned long long buckets[LATENCY_BUCKETS], double fraction) {
+    unsigned long long total = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) total += buckets[b];
+    if (total == 0) return 0;
+
+    unsigned long long seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++) {
+        seen += buckets[b];
+        if (seen >= fraction * total) return (1LL << (b + 1)) - 1;
+    }
+    return (1LL << LATENCY_BUCKETS) - 1;
+}
+
+void displayAllocatorStats() {
+    AllocatorStats stats = getAllocatorStats();
+    cout << "Allocator mode: " << (allocatorMode == BUDDY_MODE ? "buddy" : "free extents") << endl;
+    cout << "Live: " << stats.liveBytes << " bytes in " << stats.liveBlocks << " super-block(s)" << endl;
+    cout << "Free cells: " << stats.freeCells << ", largest free block: " << stats.largestFreeBlock << endl;
+    cout << "Internal fragmentation: " << stats.internalWaste << " wasted cells ("
+         << stats.internalFragmentation * 100 << "% of reserved cells)" << endl;
+    cout << "External fragmentation: " << stats.externalFragmentation * 100 << "% of free cells" << endl;
+    cout << "Splits: " << stats.freeRunSplits << " free run(s), " << stats.superBlockSplits
+         << " super-block(s); merges: " << stats.freeRunMerges << " free run(s), "
+         << stats.superBlockMerges << " super-block(s)" << endl;
+    if (!telemetryEnabled) cout << "Latencies: not measured (--no-telemetry)" << endl;
+    for (int k = 0; k < OPERATION_KINDS; k++) {
+        unsigned long long calls = 0;
+        for (int b = 0; b < LATENCY_BUCKETS; b++) calls += stats.latency[k][b];
+        if (calls == 0) continue;
+        cout << "  " << operationNames[k] << ": " << calls << " call(s), p50 <= "
+             << latencyPercentile(stats.latency[k], 0.5) << " ns, p99 <= "
+             << latencyPercentile(stats.latency[k], 0.99) << " ns" << endl;
+    }
+}
+
+// The same numbers as one JSON object, for scripts and dashboards
+string allocatorStatsToJson() {
+    AllocatorStats stats = getAllocatorStats();
+    ostringstream json;
+    json << "{\"mode\":\"" << (allocatorMode == BUDDY_MODE ? "buddy" : "extent") << "\""
+         << ",\"pool_size\":" << poolSize
+         << ",\"arenas\":" << arenas.size()
+         << ",\"live_bytes\":" << stats.liveBytes
+         << ",\"live_blocks\":" << stats.liveBlocks
+         << ",\"free_bytes\":" << stats.freeCells
+         << ",\"largest_free_extent\":" << stats.largestFreeBlock
+         << ",\"internal_waste\":" << stats.internalWaste
+         << ",\"internal_fragmentation\":" << stats.internalFragmentation
+         << ",\"external_fragmentation\":" << stats.externalFragmentation
+         << ",\"free_run_splits\":" << stats.freeRunSplits
+         << ",\"free_run_merges\":" << stats.freeRunMerges
+         << ",\"superblock_splits\":" << stats.superBlockSplits
+         << ",\"superblock_merges\":" << stats.superBlockMerges
+         << ",\"latency_ns\":{";
+    for (int k = 0; k < OPERATION_KINDS; k++) {
+        // Leave out the empty buckets at the top
+        int used = LATENCY_BUCKETS;
+        while (used > 0 && stats.latency[k][used - 1] == 0) used--;
+        unsigned long long calls = 0;
+        for (int b = 0; b < used; b++) calls += stats.latency[k][b];
+
+        if (k > 0) json << ",";
+        json << "\"" << operationNames[k] << "\":{\"count\":" << calls
+             << ",\"p50\":" << latencyPercentile(stats.latency[k], 0.5)
+             << ",\"p99\":" << latencyPercentile(stats.latency[k], 0.99)
+             << ",\"log2_buckets\":[";
+        for (int b = 0; b < used; b++) {
+            if (b > 0) json << ",";
+            json << stats.latency[k][b];
+        }
+        json << "]}";
+    }
+    json << "}}";
+    return json.str();
+}
+
+// Function to display the memory pool;
+// This shows what's actually stored in each memory block.
+// Big pools would flood the console, so only the first 64 blocks are printed for them.
+const long long DISPLAY_LIMIT = 64;
+
 void displayMemoryPool() {
-    cout << "Memory Pool:" << endl;
+    long long shown = poolSize < DISPLAY_LIMIT ? poolSize : DISPLAY_LIMIT;
+
+    cout << "Memory Pool:";
+    if (shown < poolSize) cout << " (first " << shown << " of " << poolSize << " blocks)";
+    cout << endl;
     cout << "Index:   ";
-    for (int i = 0; i < 64; i++) {
+    for (long long i = 0; i < shown; i++) {
         if (i < 10) cout << " ";  // Alignment for single-digit numbers
         cout << i << " ";
     }
     cout << endl;
     
     cout << "Data:    ";
-    for (int i = 0; i < 64; i++) {
-        cout << " " << memoryPool[i] << " ";
+    for (long long i = 0; i < shown; i++) {
+        char cell = memoryPool[i];
+        if (!isCellOccupied(i)) {
+            cell = memoryPool[i] == '\0' ? 'E' : '_';  // never used : freed
+        }
+        cout << " " << cell << " ";
     }
     cout << endl;
 }
 
-// Function to traverse the linked list and display all the metadata of the superblock;
+// Function to traverse the linked lists and display all the metadata of the superblocks;
 void DisplayLinkedList() {
     cout << "Traversing the List: " << endl;
-    if (head == NULL) {
-        cout << "  No allocated blocks" << endl;
-        return;
-    }
+    bool empty = true;
+
+    for (size_t i = 0; i < arenas.size(); i++) {
+        Arena& arena = *arenas[i];
+        if (arenas.size() > 1) {
+            cout << " Arena " << i << " (" << arena.begin << " -> " << arena.end - 1 << "):" << endl;
+        }
 
-     SuperBlock* current = head;
-    while (current != NULL) {
-        int endIndex = current->startIndex + current->sizeOfMemoryBlock - 1;
-        cout << "  " << current->Blockid << ": " << current->data 
-             << "    Indices: (" << current->startIndex << " -> " << endIndex 
-             << "), Size: " << current->sizeOfMemoryBlock << endl;
-        current = current->next;
+        SuperBlock* current = arena.head;
+        while (current != NULL) {
+            long long endIndex = current->startIndex + current->sizeOfMemoryBlock - 1;
+            cout << "  " << current->Blockid << ": " << getSuperBlockData(current)
+                 << "    Indices: (" << current->startIndex << " -> " << endIndex
+                 << "), Size: " << current->sizeOfMemoryBlock << endl;
+            current = current->next;
+            empty = false;
+        }
     }
 
+    if (empty) {
+        cout << "  No allocated blocks" << endl;
+    }
 }
 
+// Holds every arena lock (always taken in index order) so nothing changes while we print
 void displayEverything() {
+    for (size_t i = 0; i < arenas.size(); i++) {
+        arenas[i]->lock.lock();
+        drainRemoteFrees(*arenas[i]);
+    }
+
     cout << "****************************" << endl;
     displayMemoryPool();      // Show physical memory
     cout << endl;
     DisplayLinkedList();      // Show logical organization  
     cout << "****************************" << endl;
+
+    for (size_t i = 0; i < arenas.size(); i++) {
+        arenas[i]->lock.unlock();
+    }
 }
 
 void deallocateSuperBlock(int BlockId) {
-    if (head == NULL) {
-        cout << "Error: Empty list - no blocks to deallocate" << endl;
-        return;
-    }
-    
-    SuperBlock* current = head;
-    SuperBlock* prev = NULL;
-    
-    // Search for the block with matching BlockId
-    while (current != NULL && current->Blockid != BlockId) {
-        prev = current;
-        current = current->next;
-    }
-    
+    LatencyTimer timer(OP_FREE);
+    // Look up the block with matching BlockId, taking it out of the table so nobody else frees it
+    SuperBlock* current = takeSuperBlock(BlockId);
+
     // If block not found
     if (current == NULL) {
-        cout << "Error: BlockId " << BlockId << " not found" << endl;
+        if (verboseOutput) cout << "Error: BlockId " << BlockId << " not found" << endl;
         return;
     }
     
-    // Get startIndex BEFORE deleting the node
-    int startIndex = current->startIndex;
-    int size = current->sizeOfMemoryBlock;
-    
-    // FREE THE MEMORY in memoryPool
-    for (int i = startIndex; i < startIndex + size; i++) {
-        memoryPool[i] = '_';  // or 'E' - mark as free
-    }
-    
-    // Remove from linked list
-    if (prev == NULL) {
-        // Deleting the head node
-        head = current->next;
-        if (head == NULL) tail = NULL;  // Update tail if list becomes empty
+    Arena& arena = *arenas[current->arenaIndex];
+    if (current->arenaIndex == homeArenaIndex()) {
+        lock_guard<mutex> guard(arena.lock);
+        freeSuperBlockLocked(arena, current);
     } else {
-        // Deleting a middle or tail node
-        prev->next = current->next;
-        if (current == tail) tail = prev;  // Update tail if deleting last node
+        // Another thread's arena - queue it, the owner frees it on its next allocation
+        lock_guard<mutex> guard(arena.remoteFreeLock);
+        arena.remoteFrees.push_back(current);
     }
+    recordTraceEvent(TRACE_FREE, BlockId, 0, 0, 0);
     
-    delete current;
-    cout << "Memory deallocated for Super-block id: " << BlockId << endl;
+    if (verboseOutput) cout << "Memory deallocated for Super-block id: " << BlockId << endl;
+}
+
+// Frees the super-block that starts at cell `startIndex`, for callers that kept the address
+// rather than the id. Returns the freed block's id, or -1 if no block starts there.
+int deallocateSuperBlockAt(long long startIndex) {
+    LatencyTimer timer(OP_FREE);
+    for (size_t i = 0; i < arenas.size(); i++) {
+        Arena& arena = *arenas[i];
+        if (startIndex < arena.begin || startIndex >= arena.end) continue;
+
+        lock_guard<mutex> guard(arena.lock);
+        drainRemoteFrees(arena);
+        map<long long, SuperBlock*>::iterator found = arena.blocksByAddress.find(startIndex);
+        if (found == arena.blocksByAddress.end()) break;
+        int BlockId = found->second->Blockid;
+        SuperBlock* current = takeSuperBlock(BlockId);
+        if (current == NULL) break;  // someone else is freeing it right now
+        freeSuperBlockLocked(arena, current);
+        recordTraceEvent(TRACE_FREE, BlockId, 0, 0, 0);
+        return BlockId;
+    }
+    if (verboseOutput) cout << "Error: No super-block starts at index " << startIndex << endl;
+    return -1;
+}
+
+// Batch free: takes all the ids out of the table, groups the blocks by arena and frees each
+// group under one lock. In extent mode the freed ranges are sorted and neighbouring ranges are
+// joined first, so a run of adjacent blocks goes back into the free-extent index as one range.
+void deallocateSuperBlocks(const vector<int> &BlockIds) {
+    LatencyTimer timer(OP_BATCH_FREE);
+    vector<vector<SuperBlock*>> byArena(arenas.size());
+    int found = 0;
+    for (size_t i = 0; i < BlockIds.size(); i++) {
+        SuperBlock* block = takeSuperBlock(BlockIds[i]);
+        if (block == NULL) {
+            if (verboseOutput) cout << "Error: BlockId " << BlockIds[i] << " not found" << endl;
+            continue;
+        }
+        byArena[block->arenaIndex].push_back(block);
+        recordTraceEvent(TRACE_FREE, BlockIds[i], 0, 0, 0);
+        found++;
+    }
+
+    for (size_t a = 0; a < byArena.size(); a++) {
+        vector<SuperBlock*> &group = byArena[a];
+        if (group.empty()) continue;
+        Arena& arena = *arenas[a];
+        lock_guard<mutex> guard(arena.lock);
+        drainRemoteFrees(arena);
+
+        if (allocatorMode == BUDDY_MODE) {
+            for (size_t i = 0; i < group.size(); i++) {
+                freeSuperBlockLocked(arena, group[i]);
+            }
+            continue;
+        }
+
+        sort(group.begin(), group.end(), [](const SuperBlock* x, const SuperBlock* y) {
+            return x->startIndex < y->startIndex;
+        });
+
+        long long rangeStart = group[0]->startIndex;
+        long long rangeEnd = rangeStart;
+        for (size_t i = 0; i < group.size(); i++) {
+            SuperBlock* block = group[i];
+            if (block->startIndex != rangeEnd) {
+                addFreeCells(arena, rangeStart, rangeEnd - rangeStart);  // gap - flush the merged range
+                rangeStart = block->startIndex;
+            }
+            rangeEnd = block->startIndex + block->sizeOfMemoryBlock;
+
+            unlinkSuperBlock(arena, block);
+            recycleSuperBlock(arena, block);
+        }
+        addFreeCells(arena, rangeStart, rangeEnd - rangeStart);
+    }
+
+    if (verboseOutput) cout << "Memory deallocated for " << found << " super-block(s)" << endl;
+}
+
+// Cuts a block down to its first `newSize` cells and gives the rest back. The caller holds arena.lock.
+void trimSuperBlockTailLocked(Arena& arena, SuperBlock* block, long long newSize) {
+    releasePayloadCells(arena, block->startIndex + newSize, block->sizeOfMemoryBlock - newSize);
+    block->sizeOfMemoryBlock = newSize;
 }
 
 // Function 8: Deallocating PART of a superblock
-void deallocatePartOfSuperBlock(int BlockId, int partSize) {
-    if (head == NULL) {
-        cout << "Error: Empty list - no blocks to deallocate" << endl;
+void deallocatePartOfSuperBlock(int BlockId, long long partSize) {
+    LatencyTimer timer(OP_PARTIAL_FREE);
+    // Find the arena of the super-block with matching BlockId
+    int arenaIndex = findSuperBlockArena(BlockId);
+
+    // If block not found
+    if (arenaIndex == -1) {
+        if (verboseOutput) cout << "Error: BlockId " << BlockId << " not found" << endl;
         return;
     }
     
-    // Find the super-block with matching BlockId
-    SuperBlock* current = head;
-    while (current != NULL && current->Blockid != BlockId) {
-        current = current->next;
-    }
-    
-    // If block not found
+    Arena& arena = *arenas[arenaIndex];
+    lock_guard<mutex> guard(arena.lock);
+
+    // Look it up again now that we hold the lock, it may have been freed in the meantime
+    SuperBlock* current = findSuperBlock(BlockId);
     if (current == NULL) {
-        cout << "Error: BlockId " << BlockId << " not found" << endl;
+        if (verboseOutput) cout << "Error: BlockId " << BlockId << " not found" << endl;
         return;
     }
     
     // Check if partSize is valid
     if (partSize <= 0) {
-        cout << "Error: partSize must be positive" << endl;
+        if (verboseOutput) cout << "Error: partSize must be positive" << endl;
         return;
     }
     
     if (partSize >= current->sizeOfMemoryBlock) {
-        cout << "Error: partSize exceeds or matches super-block size. Use deallocateSuperBlock instead." << endl;
+        if (verboseOutput) cout << "Error: partSize exceeds or matches super-block size. Use deallocateSuperBlock instead." << endl;
         return;
     }
     
     // Free the specified portion from start in memory pool
-    int startIndex = current->startIndex;
-    for (int i = startIndex; i < startIndex + partSize; i++) {
-        memoryPool[i] = '_';
-    }
+    long long startIndex = current->startIndex;
+    releasePayloadCells(arena, startIndex, partSize);
     
     // Adjust the super-block's metadata
-    current->startIndex = startIndex + partSize;
+    setSuperBlockStart(arena, current, startIndex + partSize);
     current->sizeOfMemoryBlock = current->sizeOfMemoryBlock - partSize;
+    recordTraceEvent(TRACE_FREE_FROM_START, BlockId, 0, 0, partSize);
+
     
-    // Update the data string (remove the deallocated part from the beginning)
-    current->data = current->data.substr(partSize);
-    
-    cout << "Part of super-block deallocated: " << partSize << " blocks freed starting from index " << startIndex << endl;
+    if (verboseOutput) cout << "Part of super-block deallocated: " << partSize << " blocks freed starting from index " << startIndex << endl;
 }
 
-void deallocatePartOfSuperBlockAnywhere(int BlockId, int StartIndex, int partSize) {
-    if (head == NULL) {
-        cout << "Error: Empty list - no blocks to deallocate" << endl;
+void deallocatePartOfSuperBlockAnywhere(int BlockId, long long StartIndex, long long partSize) {
+    LatencyTimer timer(OP_PARTIAL_FREE);
+    // Find the arena of the super-block with matching BlockId
+    int arenaIndex = findSuperBlockArena(BlockId);
+
+    // If block not found
+    if (arenaIndex == -1) {
+        if (verboseOutput) cout << "Error: BlockId " << BlockId << " not found" << endl;
         return;
     }
     
-    // Find the super-block with matching BlockId
-    SuperBlock* current = head;
-    while (current != NULL && current->Blockid != BlockId) {
-        current = current->next;
-    }
-    
-    // If block not found
+    Arena& arena = *arenas[arenaIndex];
+    lock_guard<mutex> guard(arena.lock);
+
+    // Look it up again now that we hold the lock, it may have been freed in the meantime
+    SuperBlock* current = findSuperBlock(BlockId);
     if (current == NULL) {
-        cout << "Error: BlockId " << BlockId << " not found" << endl;
+        if (verboseOutput) cout << "Error: BlockId " << BlockId << " not found" << endl;
         return;
     }
     
     // Validate deallocation bounds
-    int blockStart = current->startIndex;
-    int blockEnd = blockStart + current->sizeOfMemoryBlock - 1;
-    int deallocStart = StartIndex;
-    int deallocEnd = StartIndex + partSize - 1;
+    long long blockStart = current->startIndex;
+    long long blockEnd = blockStart + current->sizeOfMemoryBlock - 1;
+    long long deallocStart = StartIndex;
+    long long deallocEnd = StartIndex + partSize - 1;
     
     // Check if deallocation is within block bounds
     if (deallocStart < blockStart || deallocEnd > blockEnd) {
-        cout << "Error: Deallocation exceeds the bounds of the super-block" << endl;
+        if (verboseOutput) cout << "Error: Deallocation exceeds the bounds of the super-block" << endl;
         return;
     }
     
     if (partSize <= 0) {
-        cout << "Error: partSize must be positive" << endl;
+        if (verboseOutput) cout << "Error: partSize must be positive" << endl;
         return;
     }
-    
-    // Free the specified portion in memory pool
-    for (int i = deallocStart; i <= deallocEnd; i++) {
-        memoryPool[i] = '_';
+
+    // A buddy block can't be shared by two super-blocks, so it can't be split in the middle
+    if (allocatorMode == BUDDY_MODE && deallocStart != blockStart && deallocEnd != blockEnd) {
+        if (verboseOutput) cout << "Error: Deallocating from the middle is not supported in buddy mode" << endl;
+        return;
     }
     
     // Handle three cases based on deallocation position
+    int splitBlockId = 0;
     if (deallocStart == blockStart) {
         // Case 1: Deallocation from start
         if (partSize == current->sizeOfMemoryBlock) {
-            // Entire block is deallocated - remove from linked list
-            deallocateSuperBlock(BlockId);
+            // Entire block is deallocated - remove from linked list. If it is no longer in the
+            // table, another thread is already freeing it (possibly through remoteFrees).
+            if (takeSuperBlock(BlockId) == NULL) {
+                if (verboseOutput) cout << "Error: BlockId " << BlockId << " not found" << endl;
+                return;
+            }
+            freeSuperBlockLocked(arena, current);
+            if (verboseOutput) cout << "Memory deallocated for Super-block id: " << BlockId << endl;
         } else {
             // Partial deallocation from start - adjust current block
-            current->startIndex = deallocEnd + 1;
+            releasePayloadCells(arena, deallocStart, partSize);
+            setSuperBlockStart(arena, current, deallocEnd + 1);
             current->sizeOfMemoryBlock = current->sizeOfMemoryBlock - partSize;
-            current->data = current->data.substr(partSize);
         }
     } else if (deallocEnd == blockEnd) {
         // Case 2: Deallocation from end - just shrink current block
-        current->sizeOfMemoryBlock = current->sizeOfMemoryBlock - partSize;
-        current->data = current->data.substr(0, current->data.length() - partSize);
+        trimSuperBlockTailLocked(arena, current, current->sizeOfMemoryBlock - partSize);
     } else {
         // Case 3: Deallocation from middle - split into two blocks
-        int firstPartSize = deallocStart - blockStart;
-        int secondPartSize = blockEnd - deallocEnd;
-        
-        string secondPartData = current->data.substr(deallocStart - blockStart + partSize);
+        addFreeCells(arena, deallocStart, partSize);
+        long long firstPartSize = deallocStart - blockStart;
+        long long secondPartSize = blockEnd - deallocEnd;
         
         // Adjust current block to be the first part
         current->sizeOfMemoryBlock = firstPartSize;
-        current->data = current->data.substr(0, firstPartSize);
         
         // Create new block for the second part
-        int newBlockStart = deallocEnd + 1;
+        long long newBlockStart = deallocEnd + 1;
         
-        SuperBlock* newBlock = new SuperBlock(newBlockStart, secondPartSize);
-        newBlock->data = secondPartData;
-        newBlock->Blockid = nextBlockId++;
+        SuperBlock* newBlock = newSuperBlock(arena, newBlockStart, secondPartSize);
+        newBlock->Blockid = takeNextBlockId();
+        newBlock->arenaIndex = arenaIndex;
+        newBlock->originId = current->originId;  // both parts still belong to the same string
         
         // Insert new block after current block in linked list
         newBlock->next = current->next;
+        newBlock->prev = current;
+        if (current->next != NULL) current->next->prev = newBlock;
         current->next = newBlock;
-        if (tail == current) tail = newBlock;  // Update tail if needed
+        if (arena.tail == current) arena.tail = newBlock;  // Update tail if needed
+        registerSuperBlock(arena, newBlock);
+        arena.superBlockSplits++;
+        splitBlockId = newBlock->Blockid;
     }
+    recordTraceEvent(TRACE_FREE_ANYWHERE, BlockId, splitBlockId, deallocStart - blockStart, partSize);
     
-    cout << "Part of super-block deallocated: " << partSize << " blocks freed starting from index " << StartIndex << endl;
+    if (verboseOutput) cout << "Part of super-block deallocated: " << partSize << " blocks freed starting from index " << StartIndex << endl;
+}
+
+// Grows or shrinks a super-block to `newSize` cells, keeping its id and its contents
+// (new cells are filled with `fill`). Like realloc, it only moves the data when it has to:
+// - shrinking trims the tail, the same way deallocating from the end does;
+// - growing takes the free cells right after the block if there are enough of them
+//   (in buddy mode: if the block's buddy block still has room);
+// - otherwise the payload is copied to a new spot in the same arena and the old cells are freed.
+// Returns false (and leaves the block as it was) if there is no room anywhere in its arena.
+template <typename Policy>
+bool resizeSuperBlock(int BlockId, long long newSize, char fill) {
+    LatencyTimer timer(OP_RESIZE);
+    int arenaIndex = findSuperBlockArena(BlockId);
+    if (arenaIndex == -1) {
+        if (verboseOutput) cout << "Error: BlockId " << BlockId << " not found" << endl;
+        return false;
+    }
+
+    Arena& arena = *arenas[arenaIndex];
+    lock_guard<mutex> guard(arena.lock);
+    drainRemoteFrees(arena);
+
+    // Look it up again now that we hold the lock, it may have been freed in the meantime
+    SuperBlock* current = findSuperBlock(BlockId);
+    if (current == NULL) {
+        if (verboseOutput) cout << "Error: BlockId " << BlockId << " not found" << endl;
+        return false;
+    }
+    if (newSize <= 0) {
+        if (verboseOutput) cout << "Error: New size must be positive. Use deallocateSuperBlock instead." << endl;
+        return false;
+    }
+
+    long long oldStart = current->startIndex;
+    long long oldSize = current->sizeOfMemoryBlock;
+    long long extra = newSize - oldSize;
+    if (extra <= 0) {
+        if (extra < 0) trimSuperBlockTailLocked(arena, current, newSize);
+        recordTraceEvent(TRACE_RESIZE, BlockId, 0, 0, newSize);
+        if (verboseOutput) cout << "Super-block " << BlockId << " resized in place to " << newSize << " blocks" << endl;
+        return true;
+    }
+
+    bool inPlace = false;
+    if (allocatorMode == BUDDY_MODE) {
+        // The cells up to the end of the buddy block are still reserved for this block
+        long long capacity = buddyBlockStart(arena, current) + (1LL << current->buddyOrder) - oldStart;
+        if (newSize <= capacity) {
+            setOccupancy(oldStart + oldSize, extra, true);
+            arena.internalWaste -= extra;
+            inPlace = true;
+        } else {
+            if (current->pinned) {
+                if (verboseOutput) cout << "Error: Super-block " << BlockId << " is pinned and cannot move" << endl;
+                return false;
+            }
+            int order = buddyOrderFor(newSize);
+            long long newStart = buddyAllocate(arena, order);
+            if (newStart == -1) {
+                if (verboseOutput) cout << "Error: Not enough memory to resize super-block " << BlockId << endl;
+                return false;
+            }
+            memcpy(memoryPool + newStart, memoryPool + oldStart, (size_t)oldSize);
+
+            // Same as freeSuperBlockLocked, minus the unlinking
+            setOccupancy(oldStart, oldSize, false);
+            arena.internalWaste -= (1LL << current->buddyOrder) - oldSize;
+            buddyFree(arena, buddyBlockStart(arena, current), current->buddyOrder);
+
+            setOccupancy(newStart, newSize, true);
+            arena.internalWaste += (1LL << order) - newSize;
+            current->buddyOrder = order;
+            setSuperBlockStart(arena, current, newStart);
+        }
+    } else {
+        map<long long, long long>::iterator after = arena.freeExtentsByStart.find(oldStart + oldSize);
+        if (after != arena.freeExtentsByStart.end() && after->second >= extra) {
+            removeFreeRange(arena, oldStart + oldSize, extra);
+            inPlace = true;
+        } else {
+            if (current->pinned) {
+                if (verboseOutput) cout << "Error: Super-block " << BlockId << " is pinned and cannot move" << endl;
+                return false;
+            }
+            // Give the old cells back first, so a free run right before or after the block
+            // can be part of the new spot; memmove copes with the two ranges overlapping.
+            addFreeCells(arena, oldStart, oldSize);
+            long long newStart = Policy::find(arena, newSize);
+            if (newStart == -1) {
+                removeFreeRange(arena, oldStart, oldSize);  // put the block back where it was
+                if (verboseOutput) cout << "Error: Not enough contiguous memory to resize super-block " << BlockId << endl;
+                return false;
+            }
+            memmove(memoryPool + newStart, memoryPool + oldStart, (size_t)oldSize);
+            removeFreeRange(arena, newStart, newSize);
+            setSuperBlockStart(arena, current, newStart);
+        }
+    }
+
+    // A moved block is no longer next to the other parts of its string, so it stands on its own
+    if (!inPlace) current->originId = current->Blockid;
+    memset(memoryPool + current->startIndex + oldSize, fill, (size_t)extra);
+    current->sizeOfMemoryBlock = newSize;
+    recordTraceEvent(TRACE_RESIZE, BlockId, 0, 0, newSize);
+
+    if (verboseOutput) {
+        cout << "Super-block " << BlockId << (inPlace ? " grown in place" : " moved to index ")
+             << (inPlace ? "" : to_string(current->startIndex)) << " (" << newSize << " blocks)" << endl;
+    }
+    return true;
+}
+
+// Same, with the current placement policy
+bool resizeSuperBlock(int BlockId, long long newSize, char fill = ' ') {
+    return withPlacementPolicy([&](auto policy) { return resizeSuperBlock<decltype(policy)>(BlockId, newSize, fill); });
+}
+
+// Compile-time configured allocator: the placement policy is a template parameter, so
+// every placement (allocate, allocateBatch, and resize when the block has to move) goes through
+// the path instantiated for that policy, with the policy's search inlined and no switch on
+// placementPolicy. With a PoolSize the cells and the bitmap are arrays
+// of that size in the program image (zero-filled, so pages nobody touched cost nothing; release()
+// only clears the pages a pool wrote) instead of a mapping made at runtime.
+// The allocator's state is still the globals above, so only one pool can be open at a time.
+// The pool remembers which MemoryPool type opened it, and the other types' calls are refused
+// instead of working on (and clobbering) a pool that isn't theirs. Objects of the same type
+// are interchangeable: they all stand for that type's one pool.
+const long long RUNTIME_POOL_SIZE = 0;
+
+template <typename Policy, long long PoolSize = RUNTIME_POOL_SIZE>
+class MemoryPool {
+    static_assert(PoolSize >= 0, "PoolSize must not be negative");
+
+public:
+    static constexpr long long capacity = PoolSize;
+
+    // `size` is only used by pools without a compile-time size
+    bool initialize(int arenaCount = 1, long long size = PoolSize) {
+        if (memoryPool != NULL) {
+            cout << "Error: A memory pool is already open" << endl;
+            return false;
+        }
+        bool ok;
+        if constexpr (PoolSize != RUNTIME_POOL_SIZE) ok = initializeMemoryPool(PoolSize, arenaCount, string(), cells, bitmap);
+        else ok = initializeMemoryPool(size, arenaCount);
+        if (ok) memoryPoolOwner = owner();
+        return ok;
+    }
+
+    SuperBlock* allocate(const std::string &str) {
+        if (!isOpen()) return nullptr;
+        return allocateSuperBlockForString<Policy>(str);
+    }
+
+    vector<SuperBlock*> allocateBatch(const vector<string> &strs) {
+        if (!isOpen()) return vector<SuperBlock*>(strs.size(), nullptr);
+        return allocateSuperBlocksForStrings<Policy>(strs);
+    }
+
+    bool resize(int BlockId, long long newSize, char fill = ' ') {
+        if (!isOpen()) return false;
+        return resizeSuperBlock<Policy>(BlockId, newSize, fill);
+    }
+
+    void deallocate(int BlockId) {
+        if (isOpen()) deallocateSuperBlock(BlockId);
+    }
+
+    void release() {
+        if (isOpen()) releaseMemoryPool();
+    }
+
+private:
+    // One address per MemoryPool type
+    static const void* owner() {
+        static const char tag = 0;
+        return &tag;
+    }
+
+    bool isOpen() {
+        if (memoryPool != NULL && memoryPoolOwner == owner()) return true;
+        if (verboseOutput) cout << "Error: This memory pool is not open" << endl;
+        return false;
+    }
+
+    alignas(64) static inline char cells[PoolSize > 0 ? PoolSize : 1];
+    alignas(64) static inline uint64_t bitmap[PoolSize > 0 ? (PoolSize + 63) / 64 : 1];
+};
+
+// Policy benchmark: the same alloc/free churn (a window of live strings of pseudo-random
+// length, the oldest one freed on every step) through a MemoryPool<Policy, N> and through the
+// runtime-selected path, for every placement policy.
+const long long POLICY_BENCH_POOL_SIZE = 1 << 20;
+
+template <typename Policy, bool CompileTime>
+double runPolicyChurn(PlacementPolicy runtimePolicy, long long operations) {
+    typedef MemoryPool<Policy, POLICY_BENCH_POOL_SIZE> Pool;  // stateless, the storage is static
+    if constexpr (CompileTime) {
+        if (!Pool().initialize()) return 0;
+    } else {
+        placementPolicy = runtimePolicy;
+        if (!initializeMemoryPool(POLICY_BENCH_POOL_SIZE, 1)) return 0;
+    }
+
+    const int WINDOW = 1024;
+    vector<int> window(WINDOW, 0);
+    vector<string> payloads;
+    for (int length = 1; length <= 256; length++) payloads.push_back(string(length, 'p'));
+    unsigned int seed = 12345;
+
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for (long long op = 0; op < operations; op++) {
+        int slot = (int)(op % WINDOW);
+        if (window[slot] != 0) deallocateSuperBlock(window[slot]);
+        seed = seed * 1103515245 + 12345;
+        const string &payload = payloads[(seed >> 16) % payloads.size()];
+        SuperBlock* block;
+        if constexpr (CompileTime) block = Pool().allocate(payload);
+        else block = allocateSuperBlockForString(payload);
+        window[slot] = block != nullptr ? block->Blockid : 0;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    releaseMemoryPool();
+    return operations / seconds;
+}
+
+template <typename Policy>
+void runPolicyBenchmarkRow(PlacementPolicy policy, long long operations) {
+    double compileTime = runPolicyChurn<Policy, true>(policy, operations);
+    double runtime = runPolicyChurn<Policy, false>(policy, operations);
+    string name = placementPolicyNames[policy];
+    cout << name << string(16 - name.size(), ' ') << (long long)compileTime << "\t\t" << (long long)runtime << endl;
+}
+
+void runPolicyBenchmark(long long operations) {
+    bool oldVerbose = verboseOutput;
+    PlacementPolicy oldPolicy = placementPolicy;
+    verboseOutput = false;
+
+    cout << "Policy          Ops/second (template)   Ops/second (runtime setting)" << endl;
+    runPolicyBenchmarkRow<FirstFitPolicy>(FIRST_FIT, operations);
+    runPolicyBenchmarkRow<BestFitPolicy>(BEST_FIT, operations);
+    runPolicyBenchmarkRow<NextFitPolicy>(NEXT_FIT, operations);
+    runPolicyBenchmarkRow<WorstFitPolicy>(WORST_FIT, operations);
+    runPolicyBenchmarkRow<SegregatedFitPolicy>(SEGREGATED_FIT, operations);
+
+    placementPolicy = oldPolicy;
+    verboseOutput = oldVerbose;
+}
+
+// The pool as a std::pmr::memory_resource, so STL containers can live in it:
+//     SuperBlockResource resource;
+//     std::pmr::vector<int> numbers(&resource);
+// Every allocation is a pinned super-block (compaction and resize never move it) at the
+// requested alignment, placed with the current placement policy. release() frees everything
+// the resource handed out in one go; containers still using that memory must not touch it
+// afterwards. The resource must not outlive the pool it allocates from.
+class SuperBlockResource : public std::pmr::memory_resource {
+public:
+    ~SuperBlockResource() {
+        if (memoryPool != NULL) release();
+    }
+
+    void release() {
+        vector<int> BlockIds;
+        {
+            lock_guard<mutex> guard(ownedLock);
+            BlockIds.assign(ownedIds.begin(), ownedIds.end());
+            ownedIds.clear();
+        }
+        deallocateSuperBlocks(BlockIds);
+    }
+
+    size_t blockCount() {
+        lock_guard<mutex> guard(ownedLock);
+        return ownedIds.size();
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        long long size = bytes == 0 ? 1 : (long long)bytes;  // every allocation needs its own address
+        SuperBlock* block = withPlacementPolicy([&](auto policy) {
+            return allocateCells<decltype(policy)>(size, (long long)alignment, NULL, true);
+        });
+        if (block == nullptr) throw bad_alloc();
+        lock_guard<mutex> guard(ownedLock);
+        ownedIds.insert(block->Blockid);
+        return memoryPool + block->startIndex;
+    }
+
+    void do_deallocate(void* p, size_t, size_t) override {
+        int BlockId = deallocateSuperBlockAt((char*)p - memoryPool);
+        if (BlockId == -1) return;
+        lock_guard<mutex> guard(ownedLock);
+        ownedIds.erase(BlockId);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    mutex ownedLock;
+    unordered_set<int> ownedIds;
+};
+
+// pmr benchmark: the same container workloads on a SuperBlockResource and on the default
+// heap (new_delete_resource), repeated `rounds` times.
+const long long PMR_BENCH_POOL_SIZE = 64LL << 20;
+
+void pmrVectorWorkload(std::pmr::memory_resource* resource) {
+    std::pmr::vector<int> numbers(resource);
+    for (int i = 0; i < 100000; i++) numbers.push_back(i);
+}
+
+void pmrStringWorkload(std::pmr::memory_resource* resource) {
+    std::pmr::vector<std::pmr::string> words(resource);
+    for (int i = 0; i < 10000; i++) {
+        words.emplace_back("a string too long for the small string buffer #");
+        words.back() += to_string(i);
+    }
+}
+
+void pmrMapWorkload(std::pmr::memory_resource* resource) {
+    std::pmr::map<int, int> squares(resource);
+    for (int i = 0; i < 10000; i++) squares[(i * 7919) % 10000] = i * i;
+}
+
+template <typename Workload>
+double timePmrWorkload(Workload workload, std::pmr::memory_resource* resource, long long rounds) {
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    for (long long r = 0; r < rounds; r++) workload(resource);
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+}
+
+void runPmrBenchmark(long long rounds) {
+    bool oldVerbose = verboseOutput;
+    verboseOutput = false;
+    if (!initializeMemoryPool(PMR_BENCH_POOL_SIZE, 1)) return;
+
+    SuperBlockResource pool;
+    std::pmr::memory_resource* heap = std::pmr::new_delete_resource();
+    cout << "Workload                  Heap (ms)   Pool (ms)" << endl;
+    cout << "pmr::vector<int> growth   " << timePmrWorkload(pmrVectorWorkload, heap, rounds) << "\t"
+         << timePmrWorkload(pmrVectorWorkload, &pool, rounds) << endl;
+    cout << "pmr::string x 10000       " << timePmrWorkload(pmrStringWorkload, heap, rounds) << "\t"
+         << timePmrWorkload(pmrStringWorkload, &pool, rounds) << endl;
+    cout << "pmr::map<int,int> x 10000 " << timePmrWorkload(pmrMapWorkload, heap, rounds) << "\t"
+         << timePmrWorkload(pmrMapWorkload, &pool, rounds) << endl;
+
+    pool.release();
+    releaseMemoryPool();
+    verboseOutput = oldVerbose;
+}
+
+// Multi-threaded benchmark: every thread keeps a window of live strings, allocating a new
+// one and freeing the oldest on every step. Every 8th free is handed to the next thread
+// instead, so the cross-thread free queues get exercised too.
+// It runs with 1, 2, 4, ... up to maxThreads threads (one arena per thread) and prints the throughput.
+void runArenaBenchmark(int maxThreads, long long operationsPerThread) {
+    const int WINDOW = 64;
+    bool oldVerbose = verboseOutput;
+    verboseOutput = false;
+
+    cout << "Threads   Ops/second   Speedup" << endl;
+    double singleThreadRate = 0;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        if (!initializeMemoryPool((long long)threads * (1 << 20), threads)) break;
+        vector<atomic<int>> handoff(threads);
+        for (int t = 0; t < threads; t++) handoff[t] = 0;
+
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        vector<thread> workers;
+        for (int t = 0; t < threads; t++) {
+            workers.push_back(thread([t, threads, operationsPerThread, &handoff]() {
+                threadSlot = t;  // one arena per thread
+                int window[WINDOW] = {0};
+                string payload(16 + t % 48, (char)('a' + t % 26));
+                for (long long op = 0; op < operationsPerThread; op++) {
+                    int slot = (int)(op % WINDOW);
+                    if (window[slot] != 0) {
+                        if (op % 8 == 0) {
+                            // hand this block to the next thread and free whatever was waiting there
+                            int other = handoff[(t + 1) % threads].exchange(window[slot]);
+                            if (other != 0) deallocateSuperBlock(other);
+                        } else {
+                            deallocateSuperBlock(window[slot]);
+                        }
+                    }
+                    SuperBlock* block = allocateSuperBlockForString(payload);
+                    window[slot] = block != nullptr ? block->Blockid : 0;
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+        double rate = (double)threads * operationsPerThread / seconds;
+        if (threads == 1) singleThreadRate = rate;
+        cout << threads << "\t  " << (long long)rate << "\t" << rate / singleThreadRate << "x" << endl;
+        releaseMemoryPool();
+    }
+    verboseOutput = oldVerbose;
+}
+
+// In a replay, every block of the trace is held by one or more blocks of this run, in the
+// order of their cells. There is more than one when the recording joined split parts that
+// are not next to each other here (another placement policy put them elsewhere).
+typedef vector<int> ReplayParts;
+
+long long replayPartsSize(const ReplayParts &parts) {
+    long long size = 0;
+    for (size_t i = 0; i < parts.size(); i++) {
+        SuperBlock* block = findSuperBlock(parts[i]);
+        if (block != NULL) size += block->sizeOfMemoryBlock;
+    }
+    return size;
+}
+
+// Frees `length` cells starting `offset` cells into a traced block. The parts that hold cells
+// in front of the freed range stay in `parts`, the ones behind it go to `tail`.
+void freeReplayRange(ReplayParts &parts, long long offset, long long length, ReplayParts &tail) {
+    ReplayParts front;
+    long long partStart = 0, end = offset + length;
+    for (size_t i = 0; i < parts.size(); i++) {
+        SuperBlock* block = findSuperBlock(parts[i]);
+        if (block == NULL) continue;
+        long long partEnd = partStart + block->sizeOfMemoryBlock;
+        long long from = max(offset, partStart), to = min(end, partEnd);
+        if (from >= to) {
+            (partEnd <= offset ? front : tail).push_back(parts[i]);
+        } else {
+            // Freeing from the middle splits the part, the second half comes right after it
+            deallocatePartOfSuperBlockAnywhere(parts[i], block->startIndex + from - partStart, to - from);
+            if (from > partStart) front.push_back(parts[i]);
+            if (to < partEnd) tail.push_back(from > partStart ? block->next->Blockid : parts[i]);
+        }
+        partStart = partEnd;
+    }
+    parts.swap(front);
+}
+
+// Joins a traced block that the recording merged into the one in front of it. Its parts are
+// appended to the survivor's, and if the two meet in this run they are merged here as well.
+void mergeReplayParts(ReplayParts &survivor, const ReplayParts &retired) {
+    if (!survivor.empty() && !retired.empty()) {
+        int arenaIndex = findSuperBlockArena(survivor.back());
+        if (arenaIndex != -1 && arenaIndex == findSuperBlockArena(retired.front())) {
+            Arena& arena = *arenas[arenaIndex];
+            lock_guard<mutex> guard(arena.lock);
+            SuperBlock* earlier = findSuperBlock(survivor.back());
+            SuperBlock* later = findSuperBlock(retired.front());
+            if (earlier != NULL && later != NULL && earlier->startIndex + earlier->sizeOfMemoryBlock == later->startIndex &&
+                mergeSuperBlockIntoLocked(arena, earlier, later)) {
+                survivor.insert(survivor.end(), retired.begin() + 1, retired.end());
+                return;
+            }
+        }
+    }
+    survivor.insert(survivor.end(), retired.begin(), retired.end());
+}
+
+// Runs every operation of a trace once. The trace's block ids are mapped to the blocks this
+// run hands out; operations on blocks whose allocation failed here are skipped.
+// With sampleFragmentation it also tracks the worst external fragmentation seen after any step.
+struct ReplayResult {
+    long long operations;
+    long long failedAllocations;
+    double seconds;
+    double peakFragmentation;
+};
+
+ReplayResult runTrace(const vector<TraceRecord> &records, bool sampleFragmentation) {
+    ReplayResult result = {0, 0, 0.0, 0.0};
+    unordered_map<int, ReplayParts> liveIds;  // trace id -> the blocks holding it in this run
+    compactionMergesParts = false;  // parts are merged where the trace says so
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < records.size(); i++) {
+        const TraceRecord &record = records[i];
+        int traceId = record.blockId, newTraceId = record.newBlockId;  // packed fields, so copy before taking references
+        if (record.op == TRACE_ALLOCATE) {
+            SuperBlock* block = allocateSuperBlockForString(string((size_t)record.size, 'x'));
+            if (block != nullptr) liveIds[traceId] = ReplayParts(1, block->Blockid);
+            else result.failedAllocations++;
+        } else if (record.op == TRACE_COMPACT) {
+            // Compactions run where the recording ran them, so the replay sees the same layout
+            // changes (an allocation that compacted is then placed without compacting again)
+            if (record.offset < 0) {
+                compactMemoryPool(record.size);
+            } else if (record.offset < (long long)arenas.size()) {
+                Arena& arena = *arenas[record.offset];
+                CompactionReport report = {0, 0, 0, 0.0, true};
+                lock_guard<mutex> guard(arena.lock);
+                drainRemoteFrees(arena);
+                compactArena(arena, record.size, report, false);
+            }
+        } else {
+            unordered_map<int, ReplayParts>::iterator live = liveIds.find(traceId);
+            if (live == liveIds.end()) continue;
+            ReplayParts &parts = live->second;
+
+            if (record.op == TRACE_FREE) {
+                for (size_t p = 0; p < parts.size(); p++) deallocateSuperBlock(parts[p]);
+                parts.clear();
+            } else if (record.op == TRACE_FREE_FROM_START || record.op == TRACE_FREE_ANYWHERE) {
+                long long offset = record.op == TRACE_FREE_ANYWHERE ? (long long)record.offset : 0;
+                ReplayParts tail;
+                freeReplayRange(parts, offset, record.size, tail);
+                if (newTraceId != 0 && !tail.empty()) liveIds[newTraceId] = tail;  // may rehash, so `parts` is not used after this
+                else parts.insert(parts.end(), tail.begin(), tail.end());
+                live = liveIds.find(traceId);
+            } else if (record.op == TRACE_RESIZE) {
+                long long size = replayPartsSize(parts);
+                if (record.size < size && parts.size() > 1) {
+                    ReplayParts tail;
+                    freeReplayRange(parts, record.size, size - record.size, tail);
+                } else if (!parts.empty()) {
+                    SuperBlock* last = findSuperBlock(parts.back());
+                    long long lastSize = last != NULL ? last->sizeOfMemoryBlock : 0;
+                    if (!resizeSuperBlock(parts.back(), lastSize + record.size - size)) result.failedAllocations++;
+                }
+            } else if (record.op == TRACE_MERGE) {
+                unordered_map<int, ReplayParts>::iterator survivor = liveIds.find(newTraceId);
+                if (survivor == liveIds.end()) continue;
+                mergeReplayParts(survivor->second, parts);
+                parts.clear();
+            }
+            if (live->second.empty()) liveIds.erase(live);
+        }
+        result.operations++;
+
+        if (sampleFragmentation) {
+            long long freeCells = 0, largest = 0;
+            for (size_t a = 0; a < arenas.size(); a++) {
+                lock_guard<mutex> guard(arenas[a]->lock);
+                freeCells += arenas[a]->freeCellCount;
+                largest = max(largest, largestFreeBlockLocked(*arenas[a]));
+            }
+            if (freeCells > 0) result.peakFragmentation = max(result.peakFragmentation, 1.0 - (double)largest / freeCells);
+        }
+    }
+
+    compactionMergesParts = true;
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    return result;
+}
+
+// Replays a recorded trace against the current placement policy and against every other
+// policy, each time on a fresh pool of the recorded size.
+// Every policy runs the trace twice: once timed, once sampling fragmentation after each step
+// (so the sampling doesn't count towards the throughput).
+bool replayTrace(const string &path) {
+    ifstream in(path, ios::binary);
+    TraceHeader header;
+    if (!in.read((char*)&header, sizeof(header)) || memcmp(header.magic, "SBTR", 4) != 0 ||
+        header.version < 1 || header.version > TRACE_VERSION) {
+        cout << "Error: '" << path << "' is not an allocation trace" << endl;
+        return false;
+    }
+    vector<TraceRecord> records;
+    TraceRecord record;
+    while (in.read((char*)&record, sizeof(record))) records.push_back(record);
+
+    // The placement policy only matters for the free-extent allocator
+    if (header.buddyMode) cout << "Note: trace was recorded in buddy mode, replaying with free extents" << endl;
+    allocatorMode = EXTENT_MODE;
+    bool oldVerbose = verboseOutput;
+    verboseOutput = false;
+
+    cout << "Replaying " << records.size() << " operations on a pool of " << header.poolSize
+         << " cells (" << header.arenaCount << " arena(s))" << endl;
+    cout << "Policy              Ops/second   Peak ext. fragmentation   Failed allocations" << endl;
+    PlacementPolicy current = placementPolicy;
+    PlacementPolicy policies[] = {current, FIRST_FIT, BEST_FIT, NEXT_FIT, WORST_FIT, SEGREGATED_FIT};
+    for (int p = 0; p < 6; p++) {
+        placementPolicy = policies[p];
+        string name = placementPolicyNames[policies[p]];
+        if (p == 0) name = "current (" + name + ")";
+
+        if (!initializeMemoryPool(header.poolSize, header.arenaCount)) break;
+        ReplayResult timed = runTrace(records, false);
+        releaseMemoryPool();
+        if (!initializeMemoryPool(header.poolSize, header.arenaCount)) break;
+        ReplayResult sampled = runTrace(records, true);
+        releaseMemoryPool();
+
+        double rate = timed.seconds > 0 ? timed.operations / timed.seconds : 0;
+        cout << name << string(name.size() < 20 ? 20 - name.size() : 1, ' ') << (long long)rate
+             << "\t " << sampled.peakFragmentation * 100 << "%\t\t\t   " << timed.failedAllocations << endl;
+    }
+
+    placementPolicy = current;
+    verboseOutput = oldVerbose;
+    return true;
+}
+
+// Script mode: runs operations from a command file (or stdin) without the menu and without
+// printing the pool after every step, then prints a summary with the timing. One command per
+// line, block ids are the ids the allocator hands out (1, 2, 3, ... in a fresh pool):
+//   alloc <string>                 (the rest of the line, like menu option 1)
+//   free <id>
+//   free-start <id> <partSize>
+//   free-range <id> <startIndex> <partSize>
+//   resize <id> <newSize>
+//   batch-alloc <string> <string> ...
+//   batch-free <id> <id> ...
+//   compact [byteBudget]
+//   display | stats | json
+// Empty lines and lines starting with # are skipped.
+
+// Cuts the next space-separated word off the front of `line`
+string_view nextWord(string_view &line) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == string_view::npos) {
+        line = string_view();
+        return line;
+    }
+    size_t end = line.find_first_of(" \t", start);
+    if (end == string_view::npos) end = line.size();
+    string_view word = line.substr(start, end - start);
+    line.remove_prefix(end);
+    return word;
+}
+
+bool parseNumber(string_view word, long long &value) {
+    if (word.empty()) return false;
+    from_chars_result result = from_chars(word.data(), word.data() + word.size(), value);
+    return result.ec == errc() && result.ptr == word.data() + word.size();
+}
+
+bool runCommandScript(istream &in, long long size, int arenaCount, const string &poolFile) {
+    // Read everything first, so the timing below is the allocator and not the disk
+    string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if (!initializeMemoryPool(size, arenaCount, poolFile)) return false;
+    bool oldVerbose = verboseOutput;
+    verboseOutput = false;
+
+    long long commands = 0, failedAllocations = 0, badLines = 0, lineNumber = 0;
+    vector<string> batchStrings;
+    vector<int> batchIds;
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+
+    size_t position = 0;
+    while (position < text.size()) {
+        size_t lineEnd = text.find('\n', position);
+        if (lineEnd == string::npos) lineEnd = text.size();
+        string_view line(text.data() + position, lineEnd - position);
+        position = lineEnd + 1;
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+        string_view command = nextWord(line);
+        if (command.empty() || command[0] == '#') continue;
+        long long a = 0, b = 0, c = 0;
+        bool ok = true;
+
+        if (command == "alloc") {
+            if (!line.empty()) line.remove_prefix(1);  // the single space after the command
+            if (allocateSuperBlockForString(string(line)) == nullptr) failedAllocations++;
+        } else if (command == "free") {
+            ok = parseNumber(nextWord(line), a);
+            if (ok) deallocateSuperBlock((int)a);
+        } else if (command == "free-start") {
+            ok = parseNumber(nextWord(line), a) && parseNumber(nextWord(line), b);
+            if (ok) deallocatePartOfSuperBlock((int)a, b);
+        } else if (command == "free-range") {
+            ok = parseNumber(nextWord(line), a) && parseNumber(nextWord(line), b) && parseNumber(nextWord(line), c);
+            if (ok) deallocatePartOfSuperBlockAnywhere((int)a, b, c);
+        } else if (command == "batch-alloc") {
+            batchStrings.clear();
+            for (string_view word = nextWord(line); !word.empty(); word = nextWord(line)) {
+                batchStrings.push_back(string(word));
+            }
+            vector<SuperBlock*> blocks = allocateSuperBlocksForStrings(batchStrings);
+            for (size_t i = 0; i < blocks.size(); i++) {
+                if (blocks[i] == nullptr) failedAllocations++;
+            }
+        } else if (command == "batch-free") {
+            batchIds.clear();
+            for (string_view word = nextWord(line); ok && !word.empty(); word = nextWord(line)) {
+                ok = parseNumber(word, a);
+                batchIds.push_back((int)a);
+            }
+            if (ok) deallocateSuperBlocks(batchIds);
+        } else if (command == "resize") {
+            ok = parseNumber(nextWord(line), a) && parseNumber(nextWord(line), b);
+            if (ok && !resizeSuperBlock((int)a, b)) failedAllocations++;
+        } else if (command == "compact") {
+            string_view word = nextWord(line);
+            ok = word.empty() || parseNumber(word, a);
+            if (ok) compactMemoryPool(a);
+        } else if (command == "display") {
+            displayEverything();
+        } else if (command == "stats") {
+            displayAllocatorStats();
+        } else if (command == "json") {
+            cout << allocatorStatsToJson() << endl;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            cout << "Error: line " << lineNumber << ": cannot understand '" << command << "'" << endl;
+            badLines++;
+            continue;
+        }
+        commands++;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    verboseOutput = oldVerbose;
+    cout << "Script finished: " << commands << " command(s) in " << seconds * 1000 << " ms ("
+         << (long long)(seconds > 0 ? commands / seconds : 0) << " per second)" << endl;
+    cout << "Failed allocations: " << failedAllocations << ", unreadable lines: " << badLines << endl;
+    displayAllocatorStats();
+    releaseMemoryPool();
+    return badLines == 0;
 }
 
-void userMemoryManagementInterface() {
+void userMemoryManagementInterface(long long size, int arenaCount, const string &poolFile) {
     int choice;
     string inputString;
-    int blockId, partSize, startIndex;
+    int blockId;
+    long long partSize, startIndex, byteBudget;
+    int batchSize;
+    vector<string> batchStrings;
+    vector<int> batchIds;
 
-    initializeMemoryPool();  // Initialize memory pool at start
+    if (!initializeMemoryPool(size, arenaCount, poolFile)) return;  // Initialize memory pool at start
     
     do {
         // Display menu
@@ -335,9 +2856,15 @@ void userMemoryManagementInterface() {
         cout << "3. Deallocate part from start of super-block" << endl;
         cout << "4. Deallocate part from anywhere in super-block" << endl;
         cout << "5. Display current status" << endl;
-        cout << "6. Exit" << endl;
-        cout << "Enter your choice (1-6): ";
-        cin >> choice;
+        cout << "6. Compact memory pool" << endl;
+        cout << "7. Show allocator statistics" << endl;
+        cout << "8. Allocate a batch of strings" << endl;
+        cout << "9. Deallocate a batch of super-blocks" << endl;
+        cout << "10. Export allocator statistics as JSON" << endl;
+        cout << "11. Resize a super-block" << endl;
+        cout << "12. Exit" << endl;
+        cout << "Enter your choice (1-12): ";
+        if (!(cin >> choice)) break;  // end of input
         
         switch(choice) {
             case 1:
@@ -385,17 +2912,157 @@ void userMemoryManagementInterface() {
                 break;
                 
             case 6:
+                // Compact memory pool, optionally only a few bytes at a time
+                cout << "Enter maximum bytes to move (0 = compact everything): ";
+                cin >> byteBudget;
+                displayCompactionReport(compactMemoryPool(byteBudget));
+                displayEverything(); // Show updated state
+                break;
+                
+            case 7:
+                // Occupancy, fragmentation, split/merge counts and latencies
+                displayAllocatorStats();
+                break;
+                
+            case 8:
+                // Allocate several strings in one go
+                cout << "Enter number of strings: ";
+                cin >> batchSize;
+                cin.ignore(); // Clear input buffer
+                batchStrings.clear();
+                for (int i = 0; i < batchSize; i++) {
+                    cout << "Enter string " << i + 1 << ": ";
+                    getline(cin, inputString);
+                    batchStrings.push_back(inputString);
+                }
+                allocateSuperBlocksForStrings(batchStrings);
+                displayEverything(); // Show updated state
+                break;
+                
+            case 9:
+                // Deallocate several blocks in one go
+                cout << "Enter number of BlockIds: ";
+                cin >> batchSize;
+                batchIds.clear();
+                for (int i = 0; i < batchSize; i++) {
+                    cout << "Enter BlockId " << i + 1 << ": ";
+                    cin >> blockId;
+                    batchIds.push_back(blockId);
+                }
+                deallocateSuperBlocks(batchIds);
+                displayEverything(); // Show updated state
+                break;
+                
+            case 10:
+                cout << allocatorStatsToJson() << endl;
+                break;
+                
+            case 11:
+                // Grow or shrink a block, moving it only if it can't grow where it is
+                cout << "Enter BlockId: ";
+                cin >> blockId;
+                cout << "Enter new size: ";
+                cin >> partSize;
+                resizeSuperBlock(blockId, partSize);
+                displayEverything(); // Show updated state
+                break;
+                
+            case 12:
                 cout << "Exiting Memory Management System..." << endl;
                 break;
                 
             default:
-                cout << "Invalid choice! Please enter 1-6." << endl;
+                cout << "Invalid choice! Please enter 1-12." << endl;
         }
         
-    } while (choice != 6);
+    } while (choice != 12);
+
+    releaseMemoryPool();
 }
 
-int main() {
-    userMemoryManagementInterface();
+// Usage: assignment_2 [poolSize] [best-fit | first-fit | next-fit | worst-fit | segregated-fit | buddy]
+//                     [--arenas N] [--bench-threads N] [--bench-policies] [--bench-pmr] [--record FILE]
+//                     [--replay FILE] [--script FILE] [--pool-file FILE] [--no-telemetry]
+// The pool has 64 blocks, one arena and uses best fit unless told otherwise on the command line.
+// buddy switches to the buddy allocator.
+// --bench-threads runs the multi-threaded benchmark instead of the menu, --bench-policies the
+// placement policy benchmark, --bench-pmr the std::pmr container benchmark.
+// --record writes an allocation trace of the menu session to FILE, --replay FILE compares the
+// placement policies on a recorded trace instead of showing the menu.
+// --script FILE runs the commands in FILE (- for stdin) instead of the menu, see runCommandScript.
+// --pool-file FILE keeps the pool in FILE, so the next run with the same file carries on where
+// this one stopped (see openPoolFile). Only for the menu and --script.
+// --no-telemetry skips the latency histograms (the occupancy and split/merge counters stay).
+int main(int argc, char* argv[]) {
+    long long size = 64;
+    int arenaCount = 1;
+    int benchThreads = 0;
+    bool benchPolicies = false;
+    bool benchPmr = false;
+    string recordPath, replayPath, scriptPath, poolFile;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "first-fit") placementPolicy = FIRST_FIT;
+        else if (arg == "best-fit") placementPolicy = BEST_FIT;
+        else if (arg == "next-fit") placementPolicy = NEXT_FIT;
+        else if (arg == "worst-fit") placementPolicy = WORST_FIT;
+        else if (arg == "segregated-fit") placementPolicy = SEGREGATED_FIT;
+        else if (arg == "buddy") allocatorMode = BUDDY_MODE;
+        else if (arg == "--arenas" && i + 1 < argc) arenaCount = atoi(argv[++i]);
+        else if (arg == "--bench-threads" && i + 1 < argc) benchThreads = atoi(argv[++i]);
+        else if (arg == "--bench-policies") benchPolicies = true;
+        else if (arg == "--bench-pmr") benchPmr = true;
+        else if (arg == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else if (arg == "--script" && i + 1 < argc) scriptPath = argv[++i];
+        else if (arg == "--pool-file" && i + 1 < argc) poolFile = argv[++i];
+        else if (arg == "--no-telemetry") telemetryEnabled = false;
+        else if (atoll(arg.c_str()) > 0) size = atoll(arg.c_str());
+        else {
+            cout << "Error: Unknown argument '" << arg << "'" << endl;
+            return 1;
+        }
+    }
+
+    // The benchmarks and the replay set up a fresh pool for every run, so a saved one would skew them
+    if (!poolFile.empty() && (benchPolicies || benchPmr || benchThreads > 0 || !replayPath.empty())) {
+        cout << "Error: --pool-file only works with the menu and --script" << endl;
+        return 1;
+    }
+    if (benchPolicies) {
+        runPolicyBenchmark(1000000);
+        return 0;
+    }
+    if (benchPmr) {
+        runPmrBenchmark(20);
+        return 0;
+    }
+    if (benchThreads > 0) {
+        runArenaBenchmark(benchThreads, 1000000);
+        return 0;
+    }
+    if (!replayPath.empty()) {
+        return replayTrace(replayPath) ? 0 : 1;
+    }
+    if (!recordPath.empty() && !startTraceRecording(recordPath, size, arenaCount)) {
+        return 1;
+    }
+    if (!scriptPath.empty()) {
+        bool ok;
+        if (scriptPath == "-") {
+            ok = runCommandScript(cin, size, arenaCount, poolFile);
+        } else {
+            ifstream script(scriptPath);
+            if (!script) {
+                cout << "Error: Could not open script '" << scriptPath << "'" << endl;
+                return 1;
+            }
+            ok = runCommandScript(script, size, arenaCount, poolFile);
+        }
+        traceFile.close();
+        return ok ? 0 : 1;
+    }
+    userMemoryManagementInterface(size, arenaCount, poolFile);
+    traceFile.close();
     return 0;
-}
\ No newline at end of file
+}